@@ -0,0 +1,705 @@
+/*
+ * Kernel micro-benchmarks
+ *
+ * Build with BENCHMARK defined and main() adds these tasks instead of the demo ones. Each
+ * kernel primitive is timed with the SysTick counter, which counts core clock cycles (its
+ * interrupt stays off, so this doesn't break the "don't use SysTick" rule). The tick interrupt
+ * is disabled while measuring, and the benchmark calls tick() itself when it needs one.
+ *
+ * Results are printed at the end as CSV:
+ *     benchmark,operations,total_cycles,cycles_per_op
+ * See "Benchmarks" in notes.txt for running them under QEMU, or on the host port, where the
+ * "cycles" are nanoseconds.
+ *
+ * Without BENCHMARK this file compiles to nothing, so its tasks, stacks and buffers take no RAM.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>           /* For expf and logf, to compare with */
+#include "stm32l031xx.h"
+#include "m0rtos.h"
+#include "float32.h"
+#include "fixed_point.h"
+#include "int_math.h"
+#include "bench.h"
+#include "util.h"
+
+#ifdef BENCHMARK
+
+#define BENCH_ITERATIONS    100
+#define MAX_RESULTS         64
+#define NUM_SLEEPERS        8
+#define SLEEP_FOREVER       0x10000000u
+
+/* SysTick counts down from 2^24 - 1 and wraps, so keep each measurement under 2^24 cycles */
+#define SYSTICK_MAX         0x00ffffffu
+#define elapsed(start, end) (((start) - (end)) & SYSTICK_MAX)
+
+#ifdef M0RTOS_HOST
+#include "m0rtos_host.h"
+
+/* Host stacks also hold a ucontext_t and the C library's stack use */
+#define STACK_WORDS(words)  16384
+#define start_cycles()
+#define read_cycles()       host_read_cycles()
+#define enable_tick()       host_enable_tick(true)
+#define disable_tick()      host_enable_tick(false)
+#else
+#define STACK_WORDS(words)  (words)
+#define start_cycles()      (SysTick->LOAD = SYSTICK_MAX, SysTick->VAL = 0,    \
+                             SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk)
+#define read_cycles()       (SysTick->VAL)
+#define enable_tick()       (NVIC->ISER[0] = TICK_BIT)
+#define disable_tick()      (NVIC->ICER[0] = TICK_BIT)
+#endif
+
+typedef struct
+{
+    const char *name;
+    unsigned    operations;
+    uint32_t    cycles;
+} bench_result_t;
+
+static void bench_main(void *arg);
+static void waiter_main(void *arg);
+static void reader_main(void *arg);
+static void pong_main(void *arg);
+static void sleeper_main(void *arg);
+
+/*
+ * waiter and reader are woken by the benchmark and pong takes turns with it. The sleepers are
+ * added by the tick benchmark, a few at a time, and go straight to sleep to fill up the
+ * suspended list - until then they don't exist, so idle runs whenever the benchmark sleeps.
+ */
+#define BENCH_TASKS(TASK)                                       \
+    TASK(waiter_task,   waiter_main,   STACK_WORDS(64),  0)     \
+    TASK(reader_task,   reader_main,   STACK_WORDS(64),  0)     \
+    TASK(bench_task,    bench_main,    STACK_WORDS(256), 1)     \
+    TASK(pong_task,     pong_main,     STACK_WORDS(64),  1)
+
+DECLARE_TASK_TABLE(bench_tasks, BENCH_TASKS);
+
+static task_t sleeper_tasks[NUM_SLEEPERS];
+static uint32_t sleeper_stacks[NUM_SLEEPERS][STACK_WORDS(64)] __ALIGNED(8);
+
+DECLARE_QUEUE(bench_q, 65);
+DECLARE_QUEUE(wake_q, 2);
+DECLARE_QUEUE(waiter_gate, 2);
+DECLARE_QUEUE(pong_gate, 2);
+
+static bench_result_t results[MAX_RESULTS];
+static unsigned num_results;
+static uint32_t overhead;
+
+static volatile uint32_t wake_stamp;
+static volatile bool waiter_active = true;
+static volatile bool pong_active;
+static unsigned num_sleepers_added;
+
+static void record(const char *name, unsigned operations, uint32_t cycles)
+{
+    if (num_results < MAX_RESULTS)
+    {
+        results[num_results].name       = name;
+        results[num_results].operations = operations;
+        results[num_results].cycles     = cycles;
+        ++num_results;
+    }
+}
+
+/*
+ * Sleep for one tick at a time, noting when it wakes, until the benchmark is finished with it
+ */
+static void waiter_main(void *arg)
+{
+    uint8_t b;
+
+    while (1)
+    {
+        sleep(1);
+        wake_stamp = read_cycles();
+        if (!waiter_active)
+        {
+            read_queue(&waiter_gate, &b, 1, -1);
+        }
+    }
+}
+
+/*
+ * Block on a queue, noting when it wakes
+ */
+static void reader_main(void *arg)
+{
+    uint8_t b;
+
+    while (1)
+    {
+        read_queue(&wake_q, &b, 1, -1);
+        wake_stamp = read_cycles();
+    }
+}
+
+/*
+ * Yield back to the benchmark (same priority) for as long as pong_active is set
+ */
+static void pong_main(void *arg)
+{
+    uint8_t b;
+
+    while (1)
+    {
+        read_queue(&pong_gate, &b, 1, -1);
+        while (pong_active)
+        {
+            yield();
+        }
+    }
+}
+
+/*
+ * Go to sleep for good, as soon as the benchmark adds this task
+ */
+static void sleeper_main(void *arg)
+{
+    while (1)
+    {
+        sleep(SLEEP_FOREVER);
+    }
+}
+
+static void bench_yield(void)
+{
+    uint32_t start;
+    unsigned i;
+
+    /* Nothing else is runnable at this priority, so there is no switch */
+    start = read_cycles();
+    for (i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        yield();
+    }
+    record("yield_no_switch", BENCH_ITERATIONS, elapsed(start, read_cycles()) - overhead);
+
+    /* Now pong is runnable too, so each yield switches there and back again */
+    pong_active = true;
+    write_queue(&pong_gate, (const uint8_t *)"", 1, 0);
+    yield();
+    start = read_cycles();
+    for (i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        yield();
+    }
+    record("context_switch", 2 * BENCH_ITERATIONS, elapsed(start, read_cycles()) - overhead);
+    pong_active = false;
+    yield();
+}
+
+static void bench_queue(const char *name, unsigned amount)
+{
+    static uint8_t buf[64];
+    uint32_t start;
+    unsigned i;
+
+    start = read_cycles();
+    for (i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        write_queue(&bench_q, buf, amount, 0);
+        read_queue(&bench_q, buf, amount, 0);
+    }
+    record(name, BENCH_ITERATIONS, elapsed(start, read_cycles()) - overhead);
+}
+
+/*
+ * Time from the tick that's due to wake a sleeping task until that task runs
+ */
+static void bench_sleep_wake(void)
+{
+    uint32_t start, total = 0;
+    unsigned i;
+
+    for (i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        start = read_cycles();
+        enter_critical();
+        tick();
+        exit_critical();
+        total += elapsed(start, wake_stamp);
+    }
+    record("sleep_wake", BENCH_ITERATIONS, total);
+
+    /* Park the waiter, so it doesn't wake on every tick from now on */
+    waiter_active = false;
+    enter_critical();
+    tick();
+    exit_critical();
+}
+
+/*
+ * Time from writing a queue until a higher priority task blocked reading it runs
+ */
+static void bench_reader_wake(void)
+{
+    uint32_t start, total = 0;
+    unsigned i;
+
+    for (i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        start = read_cycles();
+        write_queue(&wake_q, (const uint8_t *)"", 1, 0);
+        total += elapsed(start, wake_stamp);
+    }
+    record("reader_wake", BENCH_ITERATIONS, total);
+}
+
+/*
+ * Cost of a tick when no task is due, with more and more tasks on the suspended list
+ * (waiter, reader and pong are always there too)
+ */
+static void bench_tick(void)
+{
+    static const unsigned num_sleepers[] = {0, 1, 2, 4, NUM_SLEEPERS};
+    static const char *const names[] = {"tick_0_sleepers", "tick_1_sleepers", "tick_2_sleepers",
+                                        "tick_4_sleepers", "tick_8_sleepers"};
+    uint32_t start, empty, cycles;
+    unsigned i, n;
+
+    for (n = 0; n < sizeof(num_sleepers) / sizeof(num_sleepers[0]); ++n)
+    {
+        /* Add more sleepers, and let the real tick run while they go to sleep */
+        while (num_sleepers_added < num_sleepers[n])
+        {
+            enter_critical();
+            add_task(sleeper_main, &sleeper_tasks[num_sleepers_added],
+                     sleeper_stacks[num_sleepers_added], STACK_WORDS(64), 2);
+            exit_critical();
+            ++num_sleepers_added;
+        }
+        enable_tick();
+        sleep(2);
+        disable_tick();
+
+        start = read_cycles();
+        for (i = 0; i < BENCH_ITERATIONS; ++i)
+        {
+            enter_critical();
+            exit_critical();
+        }
+        empty = elapsed(start, read_cycles());
+
+        start = read_cycles();
+        for (i = 0; i < BENCH_ITERATIONS; ++i)
+        {
+            enter_critical();
+            tick();
+            exit_critical();
+        }
+        cycles = elapsed(start, read_cycles());
+        record(names[n], BENCH_ITERATIONS, cycles > empty ? cycles - empty : 0);
+    }
+}
+
+/*
+ * The maths routines, one call per operation (per element for the dot product). Each is called
+ * through a pointer from the same loop, and the cost of calling an empty function that way is
+ * taken off.
+ */
+#define DOT_LENGTH          4
+
+static f32_t f32_x, f32_y, f32_z, f32_reciprocal;
+static f32_t f32_near_x, f32_near_y;
+static f32_t f32_vx[DOT_LENGTH], f32_vy[DOT_LENGTH];
+static fix32_t fix32_x = FIX32_CONST(1.5, 28), fix32_y = FIX32_CONST(-0.875, 28), fix32_z;
+static volatile uint32_t clz_arg = 0x00012345u;
+static volatile int clz_result;
+static volatile float soft_float, soft_float_arg = 2.5f;
+
+static void f32_nothing(void)
+{
+}
+
+static void f32_add(void)
+{
+    add_f32(&f32_z, &f32_x, &f32_y);
+}
+
+/* Worst case for normalising: only the bottom bit of the answer is left */
+static void f32_subtract_worst(void)
+{
+    subtract_f32(&f32_z, &f32_near_x, &f32_near_y);
+}
+
+static void f32_multiply(void)
+{
+    multiply_f32(&f32_z, &f32_x, &f32_y);
+}
+
+static void f32_divide(void)
+{
+    divide_f32(&f32_z, &f32_x, &f32_y);
+}
+
+static void f32_multiply_reciprocal(void)
+{
+    multiply_f32(&f32_z, &f32_x, &f32_reciprocal);
+}
+
+static void f32_multiply_then_add(void)
+{
+    multiply_f32(&f32_z, &f32_x, &f32_y);
+    add_f32(&f32_z, &f32_z, &f32_x);
+}
+
+static void f32_multiply_add(void)
+{
+    multiply_add_f32(&f32_z, &f32_x, &f32_y, &f32_x);
+}
+
+static void f32_dot_product(void)
+{
+    dot_product_f32(&f32_z, f32_vx, f32_vy, DOT_LENGTH);
+}
+
+static void f32_square_root(void)
+{
+    square_root_f32(&f32_z, &f32_x);
+}
+
+static void f32_reciprocal_square_root(void)
+{
+    reciprocal_square_root_f32(&f32_z, &f32_x);
+}
+
+static void f32_cosine(void)
+{
+    cosine_f32(&f32_z, &f32_x);
+}
+
+static void f32_sine(void)
+{
+    sine_f32(&f32_z, &f32_x);
+}
+
+static void f32_tangent(void)
+{
+    tangent_f32(&f32_z, &f32_x);
+}
+
+static void f32_arctangent2(void)
+{
+    arctangent2_f32(&f32_z, &f32_y, &f32_x);
+}
+
+static void fix32_square_root(void)
+{
+    square_root_fix32(&fix32_z, &fix32_x);
+}
+
+static void fix32_reciprocal_square_root(void)
+{
+    reciprocal_square_root_fix32(&fix32_z, &fix32_x);
+}
+
+static void fix32_sine(void)
+{
+    sine_fix32(&fix32_z, &fix32_x);
+}
+
+static void fix32_arctangent2(void)
+{
+    arctangent2_fix32(&fix32_z, &fix32_y, &fix32_x);
+}
+
+static void count_leading_zeros_32(void)
+{
+    clz_result = count_leading_zeros(clz_arg);
+}
+
+static void f32_exponential(void)
+{
+    exponential_f32(&f32_z, &f32_x);
+}
+
+static void f32_logarithm(void)
+{
+    logarithm_f32(&f32_z, &f32_x);
+}
+
+static void f32_power(void)
+{
+    power_f32(&f32_z, &f32_x, &f32_y);
+}
+
+static void soft_float_expf(void)
+{
+    soft_float = expf(soft_float_arg);
+}
+
+static void soft_float_logf(void)
+{
+    soft_float = logf(soft_float_arg);
+}
+
+/*
+ * The array routines against a call per value, each over ARRAY_LENGTH values. x is spread over
+ * 2^-8 to 2^8 of either sign and y is within 2^-16 of 1, so that working on x in place with y
+ * over and over doesn't overflow.
+ */
+#define ARRAY_LENGTH        32
+
+static f32_t array_x[ARRAY_LENGTH], array_y[ARRAY_LENGTH];
+DECLARE_F32_SOA(soa_x, ARRAY_LENGTH);
+DECLARE_F32_SOA(soa_y, ARRAY_LENGTH);
+static packed_f32_t packed[ARRAY_LENGTH];
+static volatile f32_t array_sum;
+
+static void fill_arrays(void)
+{
+    uint32_t random = 12345;
+    unsigned i;
+
+    for (i = 0; i < ARRAY_LENGTH; ++i)
+    {
+        random = random * 1664525u + 1013904223u;
+        array_x[i].mantissa = random | 0x80000000u;
+        array_x[i].exponent = -31 + (int)(random & 15) - 8;
+        array_x[i].signum   = (random & 0x10) ? -1 : 1;
+        random = random * 1664525u + 1013904223u;
+        make_f32(&array_y[i], 0x40000000 + (int32_t)(random >> 16) - 0x8000, -30);
+    }
+    load_soa_f32(&soa_x, array_x, ARRAY_LENGTH);
+    load_soa_f32(&soa_y, array_y, ARRAY_LENGTH);
+}
+
+static void multiply_one_by_one(void)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_LENGTH; ++i)
+    {
+        multiply_f32(&array_x[i], &array_x[i], &array_y[i]);
+    }
+}
+
+static void multiply_array(void)
+{
+    multiply_array_f32(array_x, array_x, array_y, ARRAY_LENGTH);
+}
+
+static void multiply_soa(void)
+{
+    multiply_soa_f32(&soa_x, &soa_x, &soa_y, ARRAY_LENGTH);
+}
+
+static void add_one_by_one(void)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_LENGTH; ++i)
+    {
+        add_f32(&array_x[i], &array_x[i], &array_y[i]);
+    }
+}
+
+static void add_array(void)
+{
+    add_array_f32(array_x, array_x, array_y, ARRAY_LENGTH);
+}
+
+static void add_soa(void)
+{
+    add_soa_f32(&soa_x, &soa_x, &soa_y, ARRAY_LENGTH);
+}
+
+static void multiply_accumulate_one_by_one(void)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_LENGTH; ++i)
+    {
+        multiply_add_f32(&array_x[i], &array_y[i], &array_y[i], &array_x[i]);
+    }
+}
+
+static void multiply_accumulate_array(void)
+{
+    multiply_accumulate_array_f32(array_x, array_y, array_y, ARRAY_LENGTH);
+}
+
+static void multiply_accumulate_soa(void)
+{
+    multiply_accumulate_soa_f32(&soa_x, &soa_y, &soa_y, ARRAY_LENGTH);
+}
+
+static void sum_one_by_one(void)
+{
+    f32_t sum = plus_zero;
+    unsigned i;
+
+    for (i = 0; i < ARRAY_LENGTH; ++i)
+    {
+        add_f32(&sum, &sum, &array_x[i]);
+    }
+    array_sum = sum;
+}
+
+static void sum_array(void)
+{
+    f32_t sum;
+
+    sum_array_f32(&sum, array_x, ARRAY_LENGTH);
+    array_sum = sum;
+}
+
+static void sum_soa(void)
+{
+    f32_t sum;
+
+    sum_soa_f32(&sum, &soa_x, ARRAY_LENGTH);
+    array_sum = sum;
+}
+
+static void pack_array(void)
+{
+    pack_array_f32(packed, array_x, ARRAY_LENGTH);
+}
+
+static void unpack_array(void)
+{
+    unpack_array_f32(array_x, packed, ARRAY_LENGTH);
+}
+
+static const struct
+{
+    const char *name;
+    void      (*function)(void);
+    unsigned    operations;
+} f32_benchmarks[] =
+{
+    {"count_leading_zeros",             count_leading_zeros_32,         1},
+    {"add_f32",                         f32_add,                        1},
+    {"subtract_f32_worst",              f32_subtract_worst,             1},
+    {"multiply_f32",                    f32_multiply,                   1},
+    {"divide_f32",                      f32_divide,                     1},
+    {"multiply_by_reciprocal_f32",      f32_multiply_reciprocal,        1},
+    {"multiply_then_add_f32",           f32_multiply_then_add,          1},
+    {"multiply_add_f32",                f32_multiply_add,               1},
+    {"dot_product_f32_per_element",     f32_dot_product,                DOT_LENGTH},
+    {"square_root_f32",                 f32_square_root,                1},
+    {"reciprocal_square_root_f32",      f32_reciprocal_square_root,     1},
+    {"cosine_f32",                      f32_cosine,                     1},
+    {"sine_f32",                        f32_sine,                       1},
+    {"tangent_f32",                     f32_tangent,                    1},
+    {"arctangent2_f32",                 f32_arctangent2,                1},
+    {"exponential_f32",                 f32_exponential,                1},
+    {"logarithm_f32",                   f32_logarithm,                  1},
+    {"power_f32",                       f32_power,                      1},
+    {"soft_float_expf",                 soft_float_expf,                1},
+    {"soft_float_logf",                 soft_float_logf,                1},
+    {"square_root_fix32",               fix32_square_root,              1},
+    {"reciprocal_square_root_fix32",    fix32_reciprocal_square_root,   1},
+    {"sine_fix32",                      fix32_sine,                     1},
+    {"arctangent2_fix32",               fix32_arctangent2,              1},
+    {"multiply_f32_one_by_one",         multiply_one_by_one,            ARRAY_LENGTH},
+    {"multiply_array_f32",              multiply_array,                 ARRAY_LENGTH},
+    {"multiply_soa_f32",                multiply_soa,                   ARRAY_LENGTH},
+    {"add_f32_one_by_one",              add_one_by_one,                 ARRAY_LENGTH},
+    {"add_array_f32",                   add_array,                      ARRAY_LENGTH},
+    {"add_soa_f32",                     add_soa,                        ARRAY_LENGTH},
+    {"multiply_add_f32_one_by_one",     multiply_accumulate_one_by_one, ARRAY_LENGTH},
+    {"multiply_accumulate_array_f32",   multiply_accumulate_array,      ARRAY_LENGTH},
+    {"multiply_accumulate_soa_f32",     multiply_accumulate_soa,        ARRAY_LENGTH},
+    {"sum_f32_one_by_one",              sum_one_by_one,                 ARRAY_LENGTH},
+    {"sum_array_f32",                   sum_array,                      ARRAY_LENGTH},
+    {"sum_soa_f32",                     sum_soa,                        ARRAY_LENGTH},
+    {"pack_array_f32",                  pack_array,                     ARRAY_LENGTH},
+    {"unpack_array_f32",                unpack_array,                   ARRAY_LENGTH},
+};
+
+static uint32_t time_f32(void (*function)(void))
+{
+    uint32_t start;
+    unsigned i;
+
+    start = read_cycles();
+    for (i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        function();
+    }
+    return elapsed(start, read_cycles());
+}
+
+static void bench_f32(void)
+{
+    uint32_t empty, cycles;
+    unsigned n;
+
+    get_f32_from_float(&f32_x, 2.5f);
+    get_f32_from_float(&f32_y, 1.75f);
+    reciprocal_f32(&f32_reciprocal, &f32_y);
+    make_f32(&f32_near_x, 0x7fffffff, 0);
+    make_f32(&f32_near_y, 0x7ffffffe, 0);
+    for (n = 0; n < DOT_LENGTH; ++n)
+    {
+        make_f32(&f32_vx[n], 1000 + 37 * (int32_t)n, -8);
+        make_f32(&f32_vy[n], 3000 - 71 * (int32_t)n, -12);
+    }
+    fill_arrays();
+
+    empty = time_f32(f32_nothing);
+    for (n = 0; n < sizeof(f32_benchmarks) / sizeof(f32_benchmarks[0]); ++n)
+    {
+        cycles = time_f32(f32_benchmarks[n].function);
+        record(f32_benchmarks[n].name, BENCH_ITERATIONS * f32_benchmarks[n].operations,
+               cycles > empty ? cycles - empty : 0);
+    }
+}
+
+static void bench_main(void *arg)
+{
+    uint32_t start;
+    unsigned i;
+
+    start_cycles();
+
+    /* Take the tick interrupt out of the measurements */
+    disable_tick();
+
+    start    = read_cycles();
+    overhead = elapsed(start, read_cycles());
+
+    bench_yield();
+    bench_queue("queue_1_byte", 1);
+    bench_queue("queue_8_bytes", 8);
+    bench_queue("queue_64_bytes", 64);
+    bench_sleep_wake();
+    bench_reader_wake();
+    bench_tick();
+    bench_f32();
+
+    enable_tick();
+
+    dprintf("\nbenchmark,operations,total_cycles,cycles_per_op\n");
+    for (i = 0; i < num_results; ++i)
+    {
+        dprintf("%s,%u,%u,%u\n", results[i].name, results[i].operations, results[i].cycles,
+                (results[i].cycles + results[i].operations / 2) / results[i].operations);
+    }
+    dprintf("end\n");
+
+#ifdef M0RTOS_HOST
+    exit(0);
+#endif
+    while (1)
+    {
+        sleep(SLEEP_FOREVER);
+    }
+}
+
+void bench_add_tasks(void)
+{
+    add_task_table(bench_tasks, sizeof(bench_tasks) / sizeof(bench_tasks[0]));
+}
+
+#endif /* BENCHMARK */
@@ -0,0 +1,10 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+/*
+ * Kernel micro-benchmarks, see bench.c
+ * Call bench_add_tasks() instead of adding the application's tasks, then start_rtos().
+ */
+extern void bench_add_tasks(void);
+
+#endif
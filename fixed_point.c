@@ -11,17 +11,18 @@
 #include <stdbool.h>
 #include <string.h>         /* For strchr */
 #include "fixed_point.h"
+#include "int_math.h"
 
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
-const fix32_t pi            = {1686629713L, 29};
-const fix32_t half_pi       = {1686629713L, 30};
-const fix32_t quarter_pi    = {1686629713L, 31};
-const fix32_t two_pi        = {1686629713L, 28};
-const fix32_t third_pi      = {1124419809L, 30};
-const fix32_t two_thirds_pi = {1124419809L, 29};
-const fix32_t one_sixth_pi  = {1124419809L, 31};
+const fix32_t pi_fix32            = {1686629713L, 29};
+const fix32_t half_pi_fix32       = {1686629713L, 30};
+const fix32_t quarter_pi_fix32    = {1686629713L, 31};
+const fix32_t two_pi_fix32        = {1686629713L, 28};
+const fix32_t third_pi_fix32      = {1124419809L, 30};
+const fix32_t two_thirds_pi_fix32 = {1124419809L, 29};
+const fix32_t one_sixth_pi_fix32  = {1124419809L, 31};
 
 int sprint_fix32(char *buffer, const fix32_t *a, int decimal_places, bool plus, bool zeroes)
 {
@@ -151,41 +152,19 @@ int parse_fix32(fix32_t *ret, const char *buffer, int p_answer)
  */
 static int count_leading_space(int32_t val)
 {
-    int space = 0;
+    uint32_t magnitude;
+
     if (val == 0)
     {
         return 31;
     }
-    if (val < 0)
-    {
-        val = -val;
-    }
-    if (val < (1u << 15))
-    {
-        val <<= 16;
-        space += 16;
-    }
-    if (val < (1u << 23))
-    {
-        val <<= 8;
-        space += 8;
-    }
-    if (val < (1u << 27))
+    magnitude = (val < 0) ? -(uint32_t)val : (uint32_t)val;
+    if (magnitude & 0x80000000u)
     {
-        val <<= 4;
-        space += 4;
+        /* Only INT32_MIN */
+        return 0;
     }
-    if (val < (1u << 29))
-    {
-        val <<= 2;
-        space += 2;
-    }
-    if (val < (1u << 30))
-    {
-        space += 1;
-    }
-    
-    return space;
+    return count_leading_zeros(magnitude) - 1;
 }
 
 void normalise_fix32(fix32_t *a)
@@ -262,7 +241,7 @@ void divide_fix32(fix32_t *ret, const fix32_t *a, const fix32_t *b)
 {
     uint32_t numerator, denominator, answer, current_bit;
     bool negative;
-    int precision, i, gap;
+    int precision, i, gap, shift;
     
     /* Make both operands positive */
     if (a->mantissa < 0)
@@ -295,56 +274,12 @@ void divide_fix32(fix32_t *ret, const fix32_t *a, const fix32_t *b)
     
     /* Note precision, and shift both operands so they are at the top of the range */
     precision = 30 + a->precision - b->precision;
-    if (numerator < (1u << 16))
-    {
-        numerator <<= 16;
-        precision += 16;
-    }
-    if (denominator < (1u << 16))
-    {
-        denominator <<= 16;
-        precision -= 16;
-    }
-    if (numerator < (1u << 24))
-    {
-        numerator <<= 8;
-        precision += 8;
-    }
-    if (denominator < (1u << 24))
-    {
-        denominator <<= 8;
-        precision -= 8;
-    }
-    if (numerator < (1u << 28))
-    {
-        numerator <<= 4;
-        precision += 4;
-    }
-    if (denominator < (1u << 28))
-    {
-        denominator <<= 4;
-        precision -= 4;
-    }
-    if (numerator < (1u << 30))
-    {
-        numerator <<= 2;
-        precision += 2;
-    }
-    if (denominator < (1u << 30))
-    {
-        denominator <<= 2;
-        precision -= 2;
-    }
-    if (numerator < (1u << 31))
-    {
-        numerator <<= 1;
-        precision += 1;
-    }
-    if (denominator < (1u << 31))
-    {
-        denominator <<= 1;
-        precision -= 1;
-    }
+    shift = count_leading_zeros(numerator);
+    numerator <<= shift;
+    precision += shift;
+    shift = count_leading_zeros(denominator);
+    denominator <<= shift;
+    precision -= shift;
     /* We want the denominator as big as possible, but not bigger than the numerator */
     if (denominator > numerator)
     {
@@ -487,80 +422,175 @@ void iadd_fix32(fix32_t *ret, const fix32_t *a, int32_t b, int p_answer)
     add_fix32(ret, a, &bb, p_answer);
 }
 
-/* 
- * Uses Taylor expansion: cosine(x) = 1 - x^2/2! + x^4/4! - x^6/6! + ...
- * We assume that -pi/2 <= a <= pi/2
+/*
+ * The trig routines work on the sign, magnitude and exponent, see int_math.c
+ */
+static void unpack_fix32(unpacked_t *ret, const fix32_t *a)
+{
+    ret->negative = a->mantissa < 0;
+    ret->mantissa = ret->negative ? 0u - (uint32_t)a->mantissa : (uint32_t)a->mantissa;
+    ret->exponent = -a->precision;
+}
+
+/*
+ * Truncates towards zero, and saturates if it doesn't fit
+ * Specify precision as -1 to use the most that fits.
  */
-void cosine_fix32(fix32_t *ret, const fix32_t *a)
+static void pack_fix32(fix32_t *ret, const unpacked_t *a, int precision)
 {
-    fix32_t x2, x4, x6, x8, x10;
-
-    /* Calculate the powers of x we need - will always be non-negative */
-    multiply_fix32(&x2,  a,   a,   29);    /* Largest case  2, hence 29 bits of precision */
-    multiply_fix32(&x4,  &x2, &x2, 28);    /* Largest case  6, hence 28 bits of precision */
-    multiply_fix32(&x6,  &x4, &x2, 27);    /* Largest case 15, hence 27 bits of precision */
-    multiply_fix32(&x8,  &x4, &x4, 25);    /* Largest case 37, hence 25 bits of precision */
-    multiply_fix32(&x10, &x4, &x6, 24);    /* Largest case 91, hence 24 bits of precision */
-
-    /* Divide each term by the relevant factorial */
-    idivide_fix32(&x2,  &x2,  2      );
-    idivide_fix32(&x4,  &x4,  24     );
-    idivide_fix32(&x6,  &x6,  720    );
-    idivide_fix32(&x8,  &x8,  40320  );
-    idivide_fix32(&x10, &x10, 3628800);
-
-    /* Add up the series */
-    make_fix32(ret, 1, 0);
-    subtract_fix32(ret, ret, &x2,  30);
-    add_fix32     (ret, ret, &x4,  30);
-    subtract_fix32(ret, ret, &x6,  30);
-    add_fix32     (ret, ret, &x8,  30);
-    subtract_fix32(ret, ret, &x10, 30);
-    
-    /* Trim off any negative answers, since this is due to inaccuracy */
-    if (is_negative_fix32(ret))
+    uint32_t magnitude;
+    int shift;
+
+    if (precision < 0)
+    {
+        precision = (a->mantissa == 0) ? 31 : -1 - a->exponent - count_leading_zeros(a->mantissa);
+        precision = MAX(0, MIN(31, precision));
+    }
+    shift = a->exponent + precision;
+    if (a->mantissa == 0 || shift <= -32)
+    {
+        magnitude = 0;
+    }
+    else if (shift < 0)
+    {
+        magnitude = a->mantissa >> -shift;
+    }
+    else if (shift < count_leading_zeros(a->mantissa))
+    {
+        magnitude = a->mantissa << shift;
+    }
+    else
+    {
+        magnitude = INT32_MAX;
+    }
+    if (magnitude > INT32_MAX)
     {
-        ret->mantissa = 0L;
+        magnitude = INT32_MAX;
     }
+    ret->mantissa  = a->negative ? -(int32_t)magnitude : (int32_t)magnitude;
+    ret->precision = precision;
+}
+
+/*
+ * Any angle, in radians. The answers have 30 bits of precision.
+ */
+void sine_cosine_fix32(fix32_t *sine, fix32_t *cosine, const fix32_t *a)
+{
+    unpacked_t angle, s, c;
+
+    unpack_fix32(&angle, a);
+    sine_cosine_unpacked(&s, &c, &angle);
+    pack_fix32(sine, &s, 30);
+    pack_fix32(cosine, &c, 30);
+}
+
+void sine_fix32(fix32_t *ret, const fix32_t *a)
+{
+    unpacked_t angle, s;
+
+    unpack_fix32(&angle, a);
+    sine_cosine_unpacked(&s, NULL, &angle);
+    pack_fix32(ret, &s, 30);
+}
+
+void cosine_fix32(fix32_t *ret, const fix32_t *a)
+{
+    unpacked_t angle, c;
+
+    unpack_fix32(&angle, a);
+    sine_cosine_unpacked(NULL, &c, &angle);
+    pack_fix32(ret, &c, 30);
+}
+
+/*
+ * Saturates where the cosine is zero
+ */
+void tangent_fix32(fix32_t *ret, const fix32_t *a)
+{
+    unpacked_t angle, t;
+
+    unpack_fix32(&angle, a);
+    tangent_unpacked(&t, &angle);
+    pack_fix32(ret, &t, -1);
+}
+
+/*
+ * The angle from the x axis to (x, y), between -pi and pi, with 29 bits of precision
+ */
+void arctangent2_fix32(fix32_t *ret, const fix32_t *y, const fix32_t *x)
+{
+    unpacked_t uy, ux, angle;
+
+    unpack_fix32(&uy, y);
+    unpack_fix32(&ux, x);
+    arctangent2_unpacked(&angle, &uy, &ux);
+    pack_fix32(ret, &angle, 29);
 }
 
 /*
  * Mantissa must be positive!
- * Code adapted from the C Snippets Archive (public domain).
+ * The answer is within 1 in the last place
  */
 void square_root_fix32(fix32_t *ret, const fix32_t *a)
 {
     uint32_t x = a->mantissa;
     int precision = a->precision;
-    uint32_t acc = 0L;          /* accumulator   */
-    uint32_t rem = 0L;          /* remainder     */
-    uint32_t est = 0L;          /* trial product */
-    int i;
+    uint32_t acc;
 
+    /* The top bit is always free, so make the precision even without losing anything */
     if (a->precision & 1)
     {
-        x >>= 1;
+        x <<= 1;
+        precision += 1;
+    }
+    acc = square_root_fraction(x);
+    precision = (precision / 2) + 16;
+    if (acc > INT32_MAX || precision > 31)
+    {
+        acc >>= 1;
         precision -= 1;
     }
-    for (i = 0; i < 32; ++i)
+    ret->mantissa = (int32_t)acc;
+    ret->precision = precision;
+}
+
+/*
+ * Mantissa must be positive! Zero gives the biggest number there is.
+ * The answer is within 2 in the last place, or of 2^-31 if it's too small to use all 31 bits.
+ */
+void reciprocal_square_root_fix32(fix32_t *ret, const fix32_t *a)
+{
+    uint32_t x;
+    int shift, half_exponent, precision;
+
+    if (a->mantissa <= 0)
     {
-        rem = (rem << 2) + ((x & 0xc0000000u) >> 30);
-        x <<= 2;
-        acc <<= 1;
-        est = (acc << 1) + 1;
-        if (rem >= est)
-        {
-            rem -= est;
-            ++acc;
-        }
+        ret->mantissa  = INT32_MAX;
+        ret->precision = 0;
+        return;
     }
-    if (acc > INT32_MAX)
+
+    /*
+     * Shift up as far as possible, but keeping the exponent even, so that
+     * a = x * 2^(2 * half_exponent) with x a fraction from 1/4 to 1
+     */
+    shift = count_leading_zeros(a->mantissa);
+    if ((shift ^ a->precision) & 1)
     {
-        acc >>= 1;
-        precision -= 2;     /* subtract 2 because it is about to be halved */
+        --shift;
     }
-    ret->mantissa = (int32_t)acc;
-    ret->precision = (precision / 2) + 16;
+    x             = (uint32_t)a->mantissa << shift;
+    half_exponent = (32 - shift - a->precision) / 2;
+
+    /* The answer has 31 bits after the point, lose one to fit in an int32_t */
+    ret->mantissa = (int32_t)(reciprocal_square_root_fraction(x) >> 1);
+    precision     = 30 + half_exponent;
+    if (precision > 31)
+    {
+        ret->mantissa >>= precision - 31;
+        precision = 31;
+    }
+    ret->precision = precision;
 }
 
 void abs_fix32(fix32_t *ret, const fix32_t *a)
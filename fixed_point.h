@@ -25,7 +25,21 @@ typedef struct
     int     precision;
 } fix32_t;
 
+/*
+ * fix32_t initialisers worked out by the compiler, for const tables, e.g.
+ *     static const fix32_t gains[] = {FIX32_CONST(1.5, 24), FIX32_CONST(-0.001, 31)};
+ * FIX32_CONST() rounds to nearest, FIX32_FROM_FLOAT() truncates towards zero. For f32_t, and
+ * to find the best precision, host/f32_const.c prints initialisers to paste in.
+ * precision must be 0 to 31. FIX32_CONST() saturates a value that doesn't fit, as the routines
+ * do, so FIX32_CONST(1.0, 31) is just under 1; FIX32_FROM_FLOAT() must be given one that fits.
+ */
 #define FIX32_FROM_FLOAT(f, precision) {(int32_t)((f) * (1ul << (precision))), (precision)}
+#define FIX32_SCALED(f, precision)      ((f) * (double)(1ul << (precision)))
+#define FIX32_CONST(f, precision)                                                           \
+    {FIX32_SCALED(f, precision) >=  2147483647.0 ? INT32_MAX :                              \
+     FIX32_SCALED(f, precision) <= -2147483648.0 ? INT32_MIN :                              \
+     (int32_t)(FIX32_SCALED(f, precision) + ((f) < 0 ? -0.5 : 0.5)), (precision)}
+
 /* 
  * This routine prints out a fixed-point number in decimal.
  */
@@ -62,17 +76,27 @@ extern void      iadd_fix32(fix32_t *ret, const fix32_t *a, int32_t b, int preci
 
 /*
  * Trigonometric routines
- * Angle must be between -pi/2 and pi/2
+ * Angles are in radians, and can be any size
  */
+extern void sine_fix32(fix32_t *ret, const fix32_t *a);
 extern void cosine_fix32(fix32_t *ret, const fix32_t *a);
+extern void sine_cosine_fix32(fix32_t *sine, fix32_t *cosine, const fix32_t *a);
+extern void tangent_fix32(fix32_t *ret, const fix32_t *a);
+extern void arctangent2_fix32(fix32_t *ret, const fix32_t *y, const fix32_t *x);
 
 /* Utility functions */
 
 /*
  * Return the square root of a fixed point number
+ * The answer has precision p / 2 + 16, rounding an odd p up, or one less if that won't fit
  */
 extern void square_root_fix32(fix32_t *ret, const fix32_t *a);
 
+/*
+ * Return 1 / the square root of a fixed point number, at the best precision that fits
+ */
+extern void reciprocal_square_root_fix32(fix32_t *ret, const fix32_t *a);
+
 /*
  * Return the absolute value of a fixed point number
  */
@@ -95,9 +119,10 @@ static __inline void make_fix32(fix32_t *a, int32_t mantissa, int precision)
 }
 
 /*
- * Convert a fixed point number to an integer, truncating at the binary point
+ * Convert a fixed point number to an integer, dropping the bits after the binary point, so
+ * negative numbers round down
  */
-static __inline int32_t get_int32(const fix32_t *a)
+static __inline int32_t get_int32_fix32(const fix32_t *a)
 {
     int32_t ret;
 
@@ -111,6 +136,7 @@ static __inline int is_negative_fix32(const fix32_t *a)
     return (a->mantissa < 0);
 }
 
-extern const fix32_t pi, half_pi, quarter_pi, two_pi, third_pi, two_thirds_pi, one_sixth_pi;
+extern const fix32_t pi_fix32, half_pi_fix32, quarter_pi_fix32, two_pi_fix32, third_pi_fix32,
+                     two_thirds_pi_fix32, one_sixth_pi_fix32;
 
 #endif /* FIXED_POINT_H_ */
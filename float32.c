@@ -12,12 +12,19 @@
 #include <stdbool.h>
 #include <string.h>         /* For strchr */
 #include "float32.h"
+#include "int_math.h"
 
 #define INCLUDE_F32_TESTS       1
 
+/* Set to 1 to divide with the original 32 step long division, for comparison */
+#ifndef F32_LONG_DIVISION
+#define F32_LONG_DIVISION       0
+#endif
+
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
+/* The mantissas are rounded to nearest, as host/f32_const.c prints them */
 const f32_t plus_zero      = {0UL, INT8_MIN, +1};
 const f32_t minus_zero     = {0UL, INT8_MIN, -1};
 const f32_t plus_infinity  = {INT32_MAX, INT8_MAX, +1};
@@ -106,7 +113,7 @@ int sprint_f32(char *buffer, const f32_t *a, int decimal_places, bool plus, bool
     int exponent, len = 0;
     uint32_t integer, mantissa;
     uint32_t fraction;
-    bool scientific, negative;
+    bool scientific, negative = false;
 
     if (a->mantissa != 0 && (a->exponent > 0 || a->exponent < -64))
     {
@@ -120,12 +127,19 @@ int sprint_f32(char *buffer, const f32_t *a, int decimal_places, bool plus, bool
         /* Normal size number, print in decimal */
         scientific = false;
         mantissa = a->mantissa;
-        integer  = mantissa >> -a->exponent;
-        if (a->exponent >= -32)
+        integer  = 0;
+        fraction = 0;
+        /* Shifts of 32 or more aren't defined, and zero has exponent INT8_MIN */
+        if (a->exponent == 0)
+        {
+            integer  = mantissa;
+        }
+        else if (a->exponent > -32)
         {
+            integer  = mantissa >> -a->exponent;
             fraction = mantissa << (32 + a->exponent);
         }
-        else
+        else if (a->exponent > -64)
         {
             fraction = mantissa >> (-32 - a->exponent);
         }
@@ -237,66 +251,227 @@ int parse_f32(f32_t *ret, const char *buffer)
  *   NaN
  *   subnormal numbers
  */
+/*
+ * The 32 bits of an IEEE float, 1.fraction * 2^(exponent - 127), are the mantissa with its top
+ * bit restored, times 2^(exponent - 158). Floats under 2^-97 are below the range of f32_t, so
+ * lose bits as denormals, and under 2^-128 become zero.
+ */
+void get_f32_from_float_bits(f32_t *ret, uint32_t bits)
+{
+    uint32_t mantissa;
+    int exponent, shift;
+
+    mantissa    = ((bits & 0x007fffffu) << 8) | 0x80000000u;
+    exponent    = ((bits & 0x7f800000u) >> 23) - 158;
+    ret->signum =  (bits & 0x80000000u) ? -1 : +1;
+
+    if (exponent == 255 - 158)
+    {
+        /* Infinity or NaN */
+        ret->mantissa = UINT32_MAX;
+        ret->exponent = INT8_MAX;
+        return;
+    }
+    if (exponent == 0 - 158)
+    {
+        /* Zero, or a float denormal without the top bit, 0.fraction * 2^-126 */
+        mantissa &= 0x7fffffffu;
+        exponent  = 1 - 158;
+    }
+    if (exponent < INT8_MIN)
+    {
+        shift     = INT8_MIN - exponent;
+        mantissa  = (shift < 32) ? mantissa >> shift : 0;
+        exponent  = INT8_MIN;
+    }
+    ret->mantissa = mantissa;
+    ret->exponent = (mantissa != 0) ? exponent : INT8_MIN;
+}
+
 void get_f32_from_float(f32_t *a, float f)
 {
-    uint32_t val;
-    int exponent;
+    uint32_t bits;
 
-    /* Read the 32 bits of the float into val */
-    val = *(uint32_t *)&f;
-    
-    /* Now pick out the mantissa, exponent and sign */
-    a->mantissa = ((val & 0x007fffffu) <<  8) | 0x80000000u;
-    exponent    = ((val & 0x7f800000u) >> 23);
-    a->signum   =  (val & 0x80000000u) ? -1 : +1;
-    
-    if (exponent == 0)
+    memcpy(&bits, &f, sizeof(bits));
+    get_f32_from_float_bits(a, bits);
+}
+
+/*
+ * (mantissa + 2^(shift - 1)) >> shift, except that exact halves go to the even answer
+ */
+static uint32_t shift_rounding_to_even(uint32_t mantissa, int shift)
+{
+    uint32_t answer, remainder, half;
+
+    answer    = mantissa >> shift;
+    remainder = mantissa & ((1u << shift) - 1);
+    half      = 1u << (shift - 1);
+    if (remainder > half || (remainder == half && (answer & 1)))
     {
-        a->exponent = INT8_MIN;
-        a->mantissa = 0;
+        ++answer;
     }
-    else
+    return answer;
+}
+
+/*
+ * The float's exponent field is the f32_t's exponent + 158 once it's normalised. The mantissa
+ * is rounded to 24 bits, with its top bit landing in the exponent field as a 1 - so the field
+ * is set one low - and if rounding carries out of the top, that goes into the exponent too.
+ */
+uint32_t get_float_bits_f32(const f32_t *a)
+{
+    uint32_t sign, mantissa;
+    int exponent, shift;
+
+    sign     = (a->signum < 0) ? 0x80000000u : 0;
+    mantissa = a->mantissa;
+    if (mantissa == 0)
     {
-        a->exponent =  exponent - 158;
+        return sign;
     }
+    shift     = count_leading_zeros(mantissa);
+    mantissa <<= shift;
+    exponent  = a->exponent - shift + 158;
+
+    if (exponent >= 255)
+    {
+        return sign | 0x7f800000u;                      /* Infinity */
+    }
+    if (exponent <= 0)
+    {
+        /* A float denormal, 2^-149 at a time. Only an f32_t denormal gets here. */
+        return sign | shift_rounding_to_even(mantissa, 9 - exponent);
+    }
+    return sign + ((uint32_t)(exponent - 1) << 23) + shift_rounding_to_even(mantissa, 8);
+}
+
+float get_float_f32(const f32_t *a)
+{
+    uint32_t bits;
+    float f;
+
+    bits = get_float_bits_f32(a);
+    memcpy(&f, &bits, sizeof(f));
+    return f;
 }
 
 /*
- * Calculate by how much we could shift an unt32_t without overflow
+ * The magnitude is (mantissa >> shift), plus one if rounding takes it away from zero
  */
-static int count_leading_space(uint32_t val)
+int32_t get_int32_rounded_f32(const f32_t *a, round_mode_t mode)
 {
-    int space = 0;
-    if (val == 0)
+    uint32_t magnitude;
+    bool negative, inexact, half_or_more, round_away;
+    int shift;
+
+    negative = a->signum < 0;
+    if (a->exponent >= 0)
     {
-        return 32;
+        /* Whole already, but only fits if it's small enough not to be normalised */
+        if (a->exponent >= 32 || ((uint64_t)a->mantissa << a->exponent) > INT32_MAX)
+        {
+            return negative ? INT32_MIN : INT32_MAX;
+        }
+        magnitude = a->mantissa << a->exponent;
+        return negative ? -(int32_t)magnitude : (int32_t)magnitude;
     }
-    if (val < (1u << 16))
+
+    shift = -a->exponent;
+    if (shift < 32)
     {
-        val <<= 16;
-        space += 16;
+        magnitude    = a->mantissa >> shift;
+        inexact      = (a->mantissa & ((1u << shift) - 1)) != 0;
+        half_or_more = (a->mantissa & (1u << (shift - 1))) != 0;
     }
-    if (val < (1u << 24))
+    else
     {
-        val <<= 8;
-        space += 8;
+        /* Under one, and only a half or more if the mantissa's top bit is worth a half */
+        magnitude    = 0;
+        inexact      = a->mantissa != 0;
+        half_or_more = shift == 32 && (a->mantissa & 0x80000000u) != 0;
     }
-    if (val < (1u << 28))
+
+    switch (mode)
     {
-        val <<= 4;
-        space += 4;
+    case ROUND_DOWN:
+        round_away = negative && inexact;
+        break;
+    case ROUND_UP:
+        round_away = !negative && inexact;
+        break;
+    case ROUND_NEAREST:
+        round_away = half_or_more;
+        break;
+    default:
+        round_away = false;
+        break;
     }
-    if (val < (1u << 30))
+    if (round_away)
     {
-        val <<= 2;
-        space += 2;
+        ++magnitude;
     }
-    if (val < (1u << 31))
+
+    if (negative)
     {
-        space += 1;
+        return (magnitude >= 0x80000000u) ? INT32_MIN : -(int32_t)magnitude;
     }
-    
-    return space;
+    return (magnitude > INT32_MAX) ? INT32_MAX : (int32_t)magnitude;
+}
+
+int32_t get_int32_f32(const f32_t *a)
+{
+    return get_int32_rounded_f32(a, ROUND_TOWARDS_ZERO);
+}
+
+void get_f32_from_fix32(f32_t *ret, const fix32_t *a)
+{
+    make_f32(ret, a->mantissa, -a->precision);
+}
+
+/*
+ * The mantissa is a * 2^precision, rounded. With automatic precision, the most that fits leaves
+ * the normalised f32_t mantissa one bit short of 32 - unless rounding carries it up to 2^31,
+ * and then it takes one bit less.
+ */
+void get_fix32_from_f32(fix32_t *ret, const f32_t *a, int precision)
+{
+    f32_t scaled;
+    int32_t mantissa;
+    int exponent;
+    bool automatic;
+
+    scaled = *a;
+    normalise_f32(&scaled);
+    exponent  = scaled.exponent;
+    automatic = precision < 0;
+    if (automatic)
+    {
+        precision = MAX(0, MIN(31, -exponent - 1));
+    }
+
+    while (1)
+    {
+        if (exponent + precision > INT8_MAX)
+        {
+            mantissa = (scaled.signum < 0) ? INT32_MIN : INT32_MAX;
+        }
+        else if (exponent + precision < INT8_MIN)
+        {
+            mantissa = 0;
+        }
+        else
+        {
+            scaled.exponent = exponent + precision;
+            mantissa = get_int32_rounded_f32(&scaled, ROUND_NEAREST);
+        }
+        if (!automatic || precision == 0 || (mantissa != INT32_MAX && mantissa != INT32_MIN))
+        {
+            break;
+        }
+        --precision;
+    }
+    ret->mantissa  = mantissa;
+    ret->precision = precision;
 }
 
 void normalise_f32(f32_t *a)
@@ -309,11 +484,11 @@ void normalise_f32(f32_t *a)
         a->exponent = INT8_MIN;
         return;
     }
-    shift = count_leading_space(a->mantissa);
+    shift = count_leading_zeros(a->mantissa);
     new_exponent = a->exponent - shift;
     if (new_exponent < INT8_MIN)
     {
-        shift -= new_exponent - INT8_MIN;
+        shift = a->exponent - INT8_MIN;     /* Only as far as a denormal at INT8_MIN */
     }
     a->mantissa <<= shift;
     a->exponent -= shift;
@@ -321,31 +496,59 @@ void normalise_f32(f32_t *a)
     return;
 }
 
-void multiply_f32(f32_t *ret, const f32_t *a, const f32_t *b)
+/*
+ * ret = a * b. Normalised inputs give a product of at least 2^62, so it needs at most one shift
+ * up, and that keeps the bit below the top 32 instead of shifting in a zero.
+ */
+static __inline void _multiply_f32(f32_t *ret, const f32_t *a, const f32_t *b)
 {
-    uint32_t mantissa;
-    int exponent, signum;
+    uint64_t product;
+    int exponent, shift;
 
-    mantissa = ((uint64_t)a->mantissa * b->mantissa) >> 32;
-    exponent = a->exponent + b->exponent + 32;
-    signum   = (a->signum == b->signum ? 1 : -1);
-    
-    /* Check for overflow/underflow and saturate appropriately */
+    product     = (uint64_t)a->mantissa * b->mantissa;
+    exponent    = a->exponent + b->exponent + 32;
+    ret->signum = (a->signum == b->signum ? 1 : -1);
+
+    if (product >> 62)
+    {
+        shift = (int)(1 - (product >> 63));
+    }
+    else if (product != 0)
+    {
+        shift = count_leading_zeros_64(product);        /* A denormal input */
+    }
+    else
+    {
+        ret->mantissa = 0;
+        ret->exponent = INT8_MIN;
+        return;
+    }
+
+    /* Check for overflow/underflow and saturate appropriately, leaving a denormal if it fits */
     if (exponent > INT8_MAX)
     {
-        exponent = INT8_MAX;
-        mantissa = UINT32_MAX;
+        ret->mantissa = UINT32_MAX;
+        ret->exponent = INT8_MAX;
+        return;
     }
-    if (exponent < INT8_MIN)
+    if (exponent - shift < INT8_MIN)
     {
-        exponent = INT8_MIN;
-        mantissa = 0;
+        shift = exponent - INT8_MIN;
+        if (shift < 0)
+        {
+            /* Shift down instead, to a denormal or zero */
+            ret->mantissa = (-shift < 64) ? (uint32_t)((product >> -shift) >> 32) : 0;
+            ret->exponent = INT8_MIN;
+            return;
+        }
     }
+    ret->mantissa = (uint32_t)((product << shift) >> 32);
+    ret->exponent = exponent - shift;
+}
 
-    ret->mantissa = mantissa;
-    ret->exponent = exponent;
-    ret->signum   = signum;
-    normalise_f32(ret);
+void multiply_f32(f32_t *ret, const f32_t *a, const f32_t *b)
+{
+    _multiply_f32(ret, a, b);
 }
 
 void imultiply_f32(f32_t *ret, const f32_t *a, int32_t b)
@@ -357,10 +560,134 @@ void imultiply_f32(f32_t *ret, const f32_t *a, int32_t b)
     multiply_f32(ret, a, &bb);
 }
 
+/*
+ * 1 / a, to within 1 in the last place (the mantissa is exact, rounded down)
+ * Dividing many numbers by the same b? Multiplying each by reciprocal_f32(b) is much quicker.
+ */
+void reciprocal_f32(f32_t *ret, const f32_t *a)
+{
+    uint32_t denominator, mantissa;
+    uint64_t remainder;
+    int exponent, shift;
+
+    ret->signum = a->signum;
+    if (a->mantissa == 0)
+    {
+        ret->exponent = INT8_MAX;
+        ret->mantissa = UINT32_MAX;
+        return;
+    }
+    /* Normalise a denormal first */
+    shift       = count_leading_zeros(a->mantissa);
+    denominator = a->mantissa << shift;
+    if (denominator == 0x80000000u)
+    {
+        /* A power of two, and 2^63 / d would need 33 bits */
+        mantissa = 0x80000000u;
+        exponent = -62 - a->exponent + shift;
+    }
+    else
+    {
+        mantissa  = reciprocal_fraction(denominator);
+        remainder = 0x8000000000000000ull - (uint64_t)denominator * mantissa;
+        while (remainder >= denominator)
+        {
+            ++mantissa;
+            remainder -= denominator;
+        }
+        exponent = -63 - a->exponent + shift;
+    }
+
+    /* Check for overflow/underflow and saturate appropriately */
+    if (exponent > INT8_MAX)
+    {
+        ret->mantissa = UINT32_MAX;
+        ret->exponent = INT8_MAX;
+        return;
+    }
+    if (exponent < INT8_MIN)
+    {
+        ret->mantissa = 0;
+        ret->exponent = INT8_MIN;
+        return;
+    }
+    ret->mantissa = mantissa;
+    ret->exponent = exponent;
+}
+
+/*
+ * The quotient of two normalised mantissas, as 32 bits with the top bit set
+ * numerator / denominator is between 0.5 and 2, so when it is less than 1, scale up one more bit.
+ */
+#if F32_LONG_DIVISION
+static uint32_t divide_mantissa(uint32_t numerator, uint32_t denominator)
+{
+    uint32_t answer, current_bit;
+    int i;
+
+    /* We want the denominator as big as possible, but not bigger than the numerator */
+    if (denominator > numerator)
+    {
+        denominator >>= 1;
+    }
+
+    /*
+     * Do the long division
+     *
+     * This can be made slightly more accurate by using 64 bit values, e.g:
+     *     uint64_t numerator64   = ((uint64_t)numerator)   << 32;
+     *     uint64_t denominator64 = ((uint64_t)denominator) << 32;
+     * But this costs quite a lot more cycles.
+     */
+    answer = 0;
+    current_bit = 0x80000000u;
+    
+    for (i = 31; i >=0; --i)
+    {
+        if (numerator >= denominator)
+        {
+            answer |= current_bit;
+            numerator -= denominator;
+        }
+        denominator >>= 1;
+        current_bit >>= 1;
+    }
+    return answer;
+}
+#else
+static uint32_t divide_mantissa(uint32_t numerator, uint32_t denominator)
+{
+    uint32_t answer;
+    uint64_t remainder;
+    int shift;
+
+    if (denominator == 0x80000000u)
+    {
+        return numerator;
+    }
+    /* numerator * 2^31 / denominator, or * 2^32 if the answer would be less than 2^31 */
+    shift     = (denominator > numerator) ? 31 : 32;
+    answer    = ((uint64_t)numerator * reciprocal_fraction(denominator)) >> shift;
+    remainder = ((uint64_t)numerator << (63 - shift)) - (uint64_t)answer * denominator;
+
+    /* The reciprocal is never too big, so the answer can only be a few too small */
+    while (remainder >= denominator)
+    {
+        ++answer;
+        remainder -= denominator;
+    }
+    return answer;
+}
+#endif
+
+/*
+ * a / b, with the mantissa rounded down. With reciprocal_fraction() this is exact; the long
+ * division (F32_LONG_DIVISION) drops bits of the denominator, and can be up to 35 lower.
+ */
 void divide_f32(f32_t *ret, const f32_t *a, const f32_t *b)
 {
-    uint32_t numerator, denominator, answer, current_bit;
-    int exponent, i;
+    uint32_t numerator, denominator;
+    int exponent, shift;
     
     numerator   = a->mantissa;
     denominator = b->mantissa;
@@ -390,10 +717,16 @@ void divide_f32(f32_t *ret, const f32_t *a, const f32_t *b)
         return;
     }
     
-    /* We want the denominator as big as possible, but not bigger than the numerator */
+    /* Denormals (exponent INT8_MIN) can have leading zeroes, the division needs them normalised */
+    shift        = count_leading_zeros(numerator);
+    numerator  <<= shift;
+    exponent    -= shift;
+    shift        = count_leading_zeros(denominator);
+    denominator <<= shift;
+    exponent    += shift;
+
     if (denominator > numerator)
     {
-        denominator >>= 1;
         --exponent;
     }
     
@@ -411,29 +744,7 @@ void divide_f32(f32_t *ret, const f32_t *a, const f32_t *b)
         return;
     }
     
-    /*
-     * Do the long division
-     *
-     * This can be made slightly more accurate by using 64 bit values, e.g:
-     *     uint64_t numerator64   = ((uint64_t)numerator)   << 32;
-     *     uint64_t denominator64 = ((uint64_t)denominator) << 32;
-     * But this costs quite a lot more cycles.
-     */
-    answer = 0;
-    current_bit = 0x80000000u;
-    
-    for (i = 31; i >=0; --i)
-    {
-        if (numerator >= denominator)
-        {
-            answer |= current_bit;
-            numerator -= denominator;
-        }
-        denominator >>= 1;
-        current_bit >>= 1;
-    }
-
-    ret->mantissa = answer;
+    ret->mantissa = divide_mantissa(numerator, denominator);
     ret->exponent = exponent;
 }
 
@@ -444,10 +755,11 @@ void idivide_f32(f32_t *ret, const f32_t *a, int32_t b)
     divide_f32(ret, a, &bb);
 }
 
-static void _add_or_subtract_f32(f32_t *ret, const f32_t *a, const f32_t *b, int subtract_signum)
+static __inline void _add_or_subtract_f32(f32_t *ret, const f32_t *a, const f32_t *b, int subtract_signum)
 {
     int shift_down, exponent, signum1, signum2;
     uint32_t mantissa1, mantissa2, mantissa;
+    int shift;
     
     /*
      * Work out which of a and b is absolutely larger. We want to do an 
@@ -498,11 +810,10 @@ static void _add_or_subtract_f32(f32_t *ret, const f32_t *a, const f32_t *b, int
     ++exponent;                         /* We already halved the answer above */
     if (mantissa > 0)
     {
-        while ((mantissa & 0x80000000) == 0)
-        {
-            mantissa <<= 1;
-            --exponent;
-        }
+        /* Up to 31 places after cancellation, but it takes the same time whatever the shift */
+        shift = count_leading_zeros(mantissa);
+        mantissa <<= shift;
+        exponent -= shift;
     }
     else
     {
@@ -531,87 +842,375 @@ void iadd_f32(f32_t *ret, const f32_t *a, int32_t b)
     add_f32(ret, a, &bb);
 }
 
-/* 
- * Uses Taylor expansion: cosine(x) = 1 - x^2/2! + x^4/4! - x^6/6! + ...
- * We assume that -pi/2 <= a <= pi/2
+/*
+ * A sum of products, kept as sum * 2^exponent without normalising after every step
+ * |sum| is always under 2^62, so that adding two of them can't overflow.
  */
-void cosine_f32(f32_t *ret, const f32_t *a)
+typedef struct
 {
-    f32_t x2, x4, x6, x8, x10;
+    int64_t sum;
+    int     exponent;
+} accumulator_t;
 
-    /* Calculate the powers of x we need - will always be non-negative */
-    multiply_f32(&x2,  a,   a  );
-    multiply_f32(&x4,  &x2, &x2);
-    multiply_f32(&x6,  &x4, &x2);
-    multiply_f32(&x8,  &x4, &x4);
-    multiply_f32(&x10, &x4, &x6);
-
-    /* Divide each term by the relevant factorial */
-    /* TODO: precalculate factorials */
-    idivide_f32(&x2,  &x2,  2      );
-    idivide_f32(&x4,  &x4,  24     );
-    idivide_f32(&x6,  &x6,  720    );
-    idivide_f32(&x8,  &x8,  40320  );
-    idivide_f32(&x10, &x10, 3628800);
-
-    /* Add up the series */
-    make_f32(ret, 1, 0);
-    subtract_f32(ret, ret, &x2 );
-    add_f32     (ret, ret, &x4 );
-    subtract_f32(ret, ret, &x6 );
-    add_f32     (ret, ret, &x8 );
-    subtract_f32(ret, ret, &x10);
-    
-    /* Trim off any negative answers, since this is due to inaccuracy */
-    if (is_negative_f32(ret))
-    {
-        *ret = plus_zero;
-    }
-}
+#define ACCUMULATOR_LIMIT   0x4000000000000000ll
 
 /*
- * Argument should be positive (sign of argument is ignored).
- * Code adapted from the C Snippets Archive (public domain).
+ * Add magnitude * 2^exponent (or take it away, if negative) to the accumulator
+ * The bigger of the two sets the exponent, and the smaller is shifted down to match. If the
+ * sum is the smaller, it's shifted up as far as it will go first, so cancellation loses nothing.
  */
-void square_root_f32(f32_t *ret, const f32_t *a)
+static void accumulate(accumulator_t *acc, uint64_t magnitude, int exponent, bool negative)
 {
-    uint32_t x   = a->mantissa;
-    int exponent = a->exponent;
-    uint32_t acc = 0L;          /* accumulator   */
-    uint32_t rem = 0L;          /* remainder     */
-    uint32_t est = 0L;          /* trial product */
-    int i;
+    uint64_t sum;
+    int shift, room;
 
-    if (a->exponent & 1)
+    if (magnitude == 0)
     {
-        x >>= 1;
-        exponent += 1;
+        return;
     }
-    for (i = 0; i < 32; ++i)
+    magnitude >>= 2;
+    exponent   += 2;
+    if (acc->sum == 0)
     {
-        rem = (rem << 2) + ((x & 0xc0000000u) >> 30);
-        x <<= 2;
-        acc <<= 1;
-        est = (acc << 1) + 1;
-        if (rem >= est)
-        {
-            rem -= est;
-            ++acc;
-        }
+        acc->sum      = negative ? -(int64_t)magnitude : (int64_t)magnitude;
+        acc->exponent = exponent;
+        return;
+    }
+
+    shift = exponent - acc->exponent;
+    if (shift > 0)
+    {
+        acc->sum      = (shift < 63) ? acc->sum >> shift : 0;
+        acc->exponent = exponent;
+    }
+    else if (shift < 0)
+    {
+        sum  = acc->sum < 0 ? 0 - (uint64_t)acc->sum : (uint64_t)acc->sum;
+        room = MIN(count_leading_zeros_64(sum) - 2, -shift);
+        acc->sum      *= (int64_t)1 << room;
+        acc->exponent -= room;
+        shift         += room;
+        magnitude      = (-shift < 63) ? magnitude >> -shift : 0;
+    }
+    acc->sum += negative ? -(int64_t)magnitude : (int64_t)magnitude;
+
+    /* Keep it under 2^62 */
+    if (acc->sum >= ACCUMULATOR_LIMIT || acc->sum <= -ACCUMULATOR_LIMIT)
+    {
+        acc->sum >>= 1;
+        ++acc->exponent;
     }
-    ret->mantissa = acc;
-    ret->exponent = (exponent >> 1) - 16;
-    normalise_f32(ret);
 }
 
-void abs_f32(f32_t *ret, const f32_t *a)
+/*
+ * Add a * b to the accumulator, using the whole 64-bit product
+ */
+static __inline void accumulate_product(accumulator_t *acc, const f32_t *a, const f32_t *b)
 {
-    ret->mantissa = a->mantissa;
-    ret->exponent = a->exponent;
-    ret->signum   = 1;
+    accumulate(acc, (uint64_t)a->mantissa * b->mantissa, a->exponent + b->exponent,
+               a->signum != b->signum);
 }
 
-bool is_ge_f32(const f32_t *a, const f32_t *b)
+/*
+ * Add a to the accumulator
+ */
+static __inline void accumulate_f32(accumulator_t *acc, const f32_t *a)
+{
+    accumulate(acc, (uint64_t)a->mantissa << 32, a->exponent - 32, a->signum < 0);
+}
+
+/*
+ * Normalise the accumulator into ret, once, at the end. Saturates if it's too big, and leaves
+ * a denormal, or zero, if it's too small, as multiply_f32() does.
+ */
+static void get_accumulator_f32(f32_t *ret, const accumulator_t *acc)
+{
+    uint64_t sum;
+    int shift, exponent, down;
+
+    ret->signum = acc->sum < 0 ? -1 : 1;
+    sum         = acc->sum < 0 ? 0 - (uint64_t)acc->sum : (uint64_t)acc->sum;
+    if (sum == 0)
+    {
+        ret->mantissa = 0;
+        ret->exponent = INT8_MIN;
+        return;
+    }
+    shift    = count_leading_zeros_64(sum);
+    exponent = acc->exponent + 32 - shift;
+    if (exponent > INT8_MAX)
+    {
+        ret->mantissa = UINT32_MAX;
+        ret->exponent = INT8_MAX;
+    }
+    else if (exponent < INT8_MIN)
+    {
+        down          = INT8_MIN - exponent;
+        ret->mantissa = (down < 32) ? (uint32_t)((sum << shift) >> 32) >> down : 0;
+        ret->exponent = INT8_MIN;
+    }
+    else
+    {
+        ret->mantissa = (uint32_t)((sum << shift) >> 32);
+        ret->exponent = exponent;
+    }
+}
+
+/*
+ * ret = a * b + c, normalised once. The product keeps 62 of its 64 bits for the add.
+ */
+static __inline void _multiply_add_f32(f32_t *ret, const f32_t *a, const f32_t *b, const f32_t *c)
+{
+    accumulator_t acc = {0, 0};
+
+    accumulate_product(&acc, a, b);
+    accumulate_f32(&acc, c);
+    get_accumulator_f32(ret, &acc);
+}
+
+void multiply_add_f32(f32_t *ret, const f32_t *a, const f32_t *b, const f32_t *c)
+{
+    _multiply_add_f32(ret, a, b, c);
+}
+
+/*
+ * ret = a[0] * b[0] + a[1] * b[1] + ... + a[n - 1] * b[n - 1]
+ * The sum is kept to 62 bits, and normalised once at the end.
+ */
+void dot_product_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n)
+{
+    accumulator_t acc = {0, 0};
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        accumulate_product(&acc, &a[i], &b[i]);
+    }
+    get_accumulator_f32(ret, &acc);
+}
+
+/*
+ * The trig routines work on the sign, mantissa and exponent, see int_math.c
+ */
+static void unpack_f32(unpacked_t *ret, const f32_t *a)
+{
+    ret->mantissa = a->mantissa;
+    ret->exponent = a->exponent;
+    ret->negative = a->signum < 0;
+}
+
+static void pack_f32(f32_t *ret, const unpacked_t *a)
+{
+    ret->signum = a->negative ? -1 : 1;
+    if (a->mantissa == 0 || a->exponent < INT8_MIN)
+    {
+        ret->mantissa = 0;
+        ret->exponent = INT8_MIN;
+        return;
+    }
+    if (a->exponent > INT8_MAX)
+    {
+        ret->mantissa = UINT32_MAX;
+        ret->exponent = INT8_MAX;
+        return;
+    }
+    ret->mantissa = a->mantissa;
+    ret->exponent = a->exponent;
+}
+
+/*
+ * Any angle, in radians
+ */
+void sine_cosine_f32(f32_t *sine, f32_t *cosine, const f32_t *a)
+{
+    unpacked_t angle, s, c;
+
+    unpack_f32(&angle, a);
+    sine_cosine_unpacked(&s, &c, &angle);
+    pack_f32(sine, &s);
+    pack_f32(cosine, &c);
+}
+
+void sine_f32(f32_t *ret, const f32_t *a)
+{
+    unpacked_t angle, s;
+
+    unpack_f32(&angle, a);
+    sine_cosine_unpacked(&s, NULL, &angle);
+    pack_f32(ret, &s);
+}
+
+void cosine_f32(f32_t *ret, const f32_t *a)
+{
+    unpacked_t angle, c;
+
+    unpack_f32(&angle, a);
+    sine_cosine_unpacked(NULL, &c, &angle);
+    pack_f32(ret, &c);
+}
+
+/*
+ * Saturates where the cosine is zero
+ */
+void tangent_f32(f32_t *ret, const f32_t *a)
+{
+    unpacked_t angle, t;
+
+    unpack_f32(&angle, a);
+    tangent_unpacked(&t, &angle);
+    pack_f32(ret, &t);
+}
+
+/*
+ * The angle from the x axis to (x, y), between -pi and pi
+ */
+void arctangent2_f32(f32_t *ret, const f32_t *y, const f32_t *x)
+{
+    unpacked_t uy, ux, angle;
+
+    unpack_f32(&uy, y);
+    unpack_f32(&ux, x);
+    arctangent2_unpacked(&angle, &uy, &ux);
+    pack_f32(ret, &angle);
+}
+
+void exponential_f32(f32_t *ret, const f32_t *a)
+{
+    unpacked_t ua, e;
+
+    unpack_f32(&ua, a);
+    exponential_unpacked(&e, &ua, LOG_BASE_E);
+    pack_f32(ret, &e);
+}
+
+void exponential2_f32(f32_t *ret, const f32_t *a)
+{
+    unpacked_t ua, e;
+
+    unpack_f32(&ua, a);
+    exponential_unpacked(&e, &ua, LOG_BASE_2);
+    pack_f32(ret, &e);
+}
+
+/*
+ * The sign of the argument is ignored, and the log of zero saturates to minus infinity
+ */
+static void logarithm_base_f32(f32_t *ret, const f32_t *a, log_base_t base)
+{
+    unpacked_t ua, l;
+
+    unpack_f32(&ua, a);
+    logarithm_unpacked(&l, &ua, base);
+    pack_f32(ret, &l);
+}
+
+void logarithm_f32(f32_t *ret, const f32_t *a)
+{
+    logarithm_base_f32(ret, a, LOG_BASE_E);
+}
+
+void logarithm2_f32(f32_t *ret, const f32_t *a)
+{
+    logarithm_base_f32(ret, a, LOG_BASE_2);
+}
+
+void logarithm10_f32(f32_t *ret, const f32_t *a)
+{
+    logarithm_base_f32(ret, a, LOG_BASE_10);
+}
+
+/*
+ * x^y. x can only be negative if y is a whole number, otherwise the sign of x is ignored.
+ */
+void power_f32(f32_t *ret, const f32_t *x, const f32_t *y)
+{
+    unpacked_t ux, uy, p;
+
+    unpack_f32(&ux, x);
+    unpack_f32(&uy, y);
+    power_unpacked(&p, &ux, &uy);
+    pack_f32(ret, &p);
+}
+
+/*
+ * Argument should be positive (sign of argument is ignored).
+ * The mantissa is exact, rounded down, when the normalised exponent is even, or the argument
+ * is a denormal with a spare bit. Otherwise the odd exponent costs the bottom bit of the
+ * mantissa, so the answer is within 1.5 in the last place.
+ */
+void square_root_f32(f32_t *ret, const f32_t *a)
+{
+    uint32_t x;
+    int exponent, shift;
+
+    ret->signum = 1;
+    if (a->mantissa == 0)
+    {
+        ret->mantissa = 0;
+        ret->exponent = INT8_MIN;
+        return;
+    }
+
+    /* Normalise a denormal, then a = x * 2^exponent with an even exponent */
+    shift    = count_leading_zeros(a->mantissa);
+    exponent = a->exponent - shift;
+    if ((exponent & 1) && shift > 0)
+    {
+        --shift;
+        ++exponent;
+    }
+    x = a->mantissa << shift;
+    if (exponent & 1)
+    {
+        x >>= 1;
+        exponent += 1;
+    }
+
+    /* x is at least 2^30, so the root is at least 2^31 and comes out normalised */
+    ret->mantissa = square_root_fraction(x);
+    ret->exponent = exponent / 2 - 16;
+}
+
+/*
+ * 1 / sqrt(a), to within 2 in the last place. Sign of argument is ignored.
+ * Normalising a vector? Multiplying by this is much quicker than dividing by square_root_f32().
+ */
+void reciprocal_square_root_f32(f32_t *ret, const f32_t *a)
+{
+    uint32_t x;
+    int exponent, shift;
+
+    ret->signum = 1;
+    if (a->mantissa == 0)
+    {
+        ret->exponent = INT8_MAX;
+        ret->mantissa = UINT32_MAX;
+        return;
+    }
+
+    /* Normalise a denormal, then a = x * 2^exponent with an even exponent */
+    shift    = count_leading_zeros(a->mantissa);
+    x        = a->mantissa << shift;
+    exponent = a->exponent - shift + 32;
+    if (exponent & 1)
+    {
+        x >>= 1;
+        exponent += 1;
+    }
+
+    /* The answer is always more than 1 / sqrt(2^exponent), so comes out normalised */
+    ret->mantissa = reciprocal_square_root_fraction(x);
+    ret->exponent = -31 - exponent / 2;
+}
+
+void abs_f32(f32_t *ret, const f32_t *a)
+{
+    ret->mantissa = a->mantissa;
+    ret->exponent = a->exponent;
+    ret->signum   = 1;
+}
+
+static __inline bool _is_ge_f32(const f32_t *a, const f32_t *b)
 {
     if (a->signum > 0)
     {
@@ -653,6 +1252,294 @@ bool is_ge_f32(const f32_t *a, const f32_t *b)
     }
 }
 
+bool is_ge_f32(const f32_t *a, const f32_t *b)
+{
+    return _is_ge_f32(a, b);
+}
+
+/*
+ * Arrays. Each of these works through the arrays with the same code as the single-value routine,
+ * inlined, so gives exactly the same answers without a call per value.
+ */
+void add_array_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        _add_or_subtract_f32(&ret[i], &a[i], &b[i], 1);
+    }
+}
+
+void subtract_array_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        _add_or_subtract_f32(&ret[i], &a[i], &b[i], -1);
+    }
+}
+
+void multiply_array_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        _multiply_f32(&ret[i], &a[i], &b[i]);
+    }
+}
+
+void scale_array_f32(f32_t *ret, const f32_t *a, const f32_t *k, unsigned n)
+{
+    f32_t scale = *k;               /* In case k is in ret */
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        _multiply_f32(&ret[i], &a[i], &scale);
+    }
+}
+
+void multiply_accumulate_array_f32(f32_t *acc, const f32_t *a, const f32_t *b, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        _multiply_add_f32(&acc[i], &a[i], &b[i], &acc[i]);
+    }
+}
+
+void sum_array_f32(f32_t *ret, const f32_t *a, unsigned n)
+{
+    accumulator_t acc = {0, 0};
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        accumulate_f32(&acc, &a[i]);
+    }
+    get_accumulator_f32(ret, &acc);
+}
+
+void min_array_f32(f32_t *ret, const f32_t *a, unsigned n)
+{
+    f32_t min;
+    unsigned i;
+
+    if (n == 0)
+    {
+        *ret = plus_infinity;
+        return;
+    }
+    min = a[0];
+    for (i = 1; i < n; ++i)
+    {
+        if (!_is_ge_f32(&a[i], &min))
+        {
+            min = a[i];
+        }
+    }
+    *ret = min;
+}
+
+void max_array_f32(f32_t *ret, const f32_t *a, unsigned n)
+{
+    f32_t max;
+    unsigned i;
+
+    if (n == 0)
+    {
+        *ret = minus_infinity;
+        return;
+    }
+    max = a[0];
+    for (i = 1; i < n; ++i)
+    {
+        if (_is_ge_f32(&a[i], &max))
+        {
+            max = a[i];
+        }
+    }
+    *ret = max;
+}
+
+/*
+ * The same for structures of arrays. Each value is gathered into an f32_t that the compiler can
+ * keep in registers, and only the three separate arrays are read and written.
+ */
+void load_soa_f32(f32_soa_t *ret, const f32_t *a, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        set_soa_f32(ret, i, &a[i]);
+    }
+}
+
+void store_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        get_soa_f32(&ret[i], a, i);
+    }
+}
+
+void add_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_soa_t *b, unsigned n)
+{
+    f32_t x, y;
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        get_soa_f32(&x, a, i);
+        get_soa_f32(&y, b, i);
+        _add_or_subtract_f32(&x, &x, &y, 1);
+        set_soa_f32(ret, i, &x);
+    }
+}
+
+void subtract_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_soa_t *b, unsigned n)
+{
+    f32_t x, y;
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        get_soa_f32(&x, a, i);
+        get_soa_f32(&y, b, i);
+        _add_or_subtract_f32(&x, &x, &y, -1);
+        set_soa_f32(ret, i, &x);
+    }
+}
+
+void multiply_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_soa_t *b, unsigned n)
+{
+    f32_t x, y;
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        get_soa_f32(&x, a, i);
+        get_soa_f32(&y, b, i);
+        _multiply_f32(&x, &x, &y);
+        set_soa_f32(ret, i, &x);
+    }
+}
+
+void scale_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_t *k, unsigned n)
+{
+    f32_t x, scale = *k;
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        get_soa_f32(&x, a, i);
+        _multiply_f32(&x, &x, &scale);
+        set_soa_f32(ret, i, &x);
+    }
+}
+
+void multiply_accumulate_soa_f32(f32_soa_t *acc, const f32_soa_t *a, const f32_soa_t *b,
+                                 unsigned n)
+{
+    f32_t x, y, z;
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        get_soa_f32(&x, a, i);
+        get_soa_f32(&y, b, i);
+        get_soa_f32(&z, acc, i);
+        _multiply_add_f32(&z, &x, &y, &z);
+        set_soa_f32(acc, i, &z);
+    }
+}
+
+void sum_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n)
+{
+    accumulator_t acc = {0, 0};
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        accumulate(&acc, (uint64_t)a->mantissa[i] << 32, a->exponent[i] - 32, a->signum[i] < 0);
+    }
+    get_accumulator_f32(ret, &acc);
+}
+
+void min_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n)
+{
+    f32_t x, min;
+    unsigned i;
+
+    if (n == 0)
+    {
+        *ret = plus_infinity;
+        return;
+    }
+    get_soa_f32(&min, a, 0);
+    for (i = 1; i < n; ++i)
+    {
+        get_soa_f32(&x, a, i);
+        if (!_is_ge_f32(&x, &min))
+        {
+            min = x;
+        }
+    }
+    *ret = min;
+}
+
+void max_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n)
+{
+    f32_t x, max;
+    unsigned i;
+
+    if (n == 0)
+    {
+        *ret = minus_infinity;
+        return;
+    }
+    get_soa_f32(&max, a, 0);
+    for (i = 1; i < n; ++i)
+    {
+        get_soa_f32(&x, a, i);
+        if (_is_ge_f32(&x, &max))
+        {
+            max = x;
+        }
+    }
+    *ret = max;
+}
+
+/*
+ * Pack or unpack n values, see packed_f32_t
+ */
+void pack_array_f32(packed_f32_t *ret, const f32_t *a, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        ret[i] = get_packed_f32(&a[i]);
+    }
+}
+
+void unpack_array_f32(f32_t *ret, const packed_f32_t *a, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        get_f32_from_packed(&ret[i], a[i]);
+    }
+}
+
 #if INCLUDE_F32_TESTS
 #include "util.h"
 #include "m0rtos.h"
@@ -687,6 +1574,21 @@ struct f_s
     float answer;
 };
 
+struct fff_s
+{
+    float x;
+    float y;
+    float w;
+    float answer;
+};
+
+struct yx_s
+{
+    float y;
+    float x;
+    float answer;
+};
+
 static const struct ff_s test_ff[] = 
 {
     /*  x           y             x*y       x/y            y/x           x+y         x-y           y-x          x>=y    y>=x */
@@ -702,6 +1604,195 @@ static const struct fi_s test_fi[] =
     {1.23456e+6, 1000000000, 1.23456e15,    1.23456e-3,     1001234560,   -998765440   },
     {3.33333333, 1000000000, 3.33333333e+9, 3.33333333e-9,  1000000003.3, -1000000003.3},
 };
+static const struct fff_s test_multiply_add[] =
+{
+    /* x             y               w          x*y+w          */
+    { 3.33333333,    1.11111111,     1.0,       4.70370379     },
+    {-3.33333333,    1.11111111,     1.0,      -2.70370379     },
+    { 1.00000095367, 0.999999046326, -1.0,     -9.094947e-13  },   /* (1 + 2^-20)(1 - 2^-20) - 1 */
+    { 1e10,          1e10,           -1e20,    -2004087734272.0},   /* 1e20 isn't exact as a float */
+};
+
+/* The dot product of each row of test_dot_x with test_dot_y */
+static const float test_dot_x[][4] =
+{
+    { 1e10, 1.0,  -1e10, 0.0   },
+    { 1.5, -2.0,   0.25, 4.0   },
+};
+static const float test_dot_y[4]     = {1.0, 0.5, 1.0, -0.125};
+static const float test_dot_answer[] = {0.5, 0.25};
+
+/* The array routines are tried on the columns of test_ff */
+#define TEST_ARRAY_LENGTH   (sizeof(test_ff) / sizeof(test_ff[0]))
+DECLARE_F32_SOA(test_soa_x, TEST_ARRAY_LENGTH);
+DECLARE_F32_SOA(test_soa_y, TEST_ARRAY_LENGTH);
+DECLARE_F32_SOA(test_soa_z, TEST_ARRAY_LENGTH);
+static packed_f32_t test_packed[TEST_ARRAY_LENGTH];
+
+/*
+ * The edges of packing: zero, the biggest, denormals and an unnormalised value. With exponent
+ * -128 only the top 23 bits of the mantissa are kept, so a denormal loses its bottom 9.
+ */
+static const f32_t test_packing[] =
+{
+    {0,           INT8_MIN, -1},
+    {UINT32_MAX,  INT8_MAX,  1},
+    {0x80000000u, INT8_MIN,  1},
+    {0x12345600u, INT8_MIN, -1},
+    {0x00012345u, -40,       1},
+};
+
+/* Initialisers from host/f32_const.c, which should match get_f32_from_float() */
+static const struct
+{
+    f32_t constant;
+    float f;
+} test_constants[] =
+{
+    {{3221225472UL,  -31, +1},  1.5},
+    {{2748779069UL,  -40, -1}, -2.5e-3},
+    {{2528395039UL,  -11, +1},  1234567.89},
+    {{3388131789UL,   68, +1},  1e30},
+    {{4153837487UL, -115, -1}, -1e-25},
+    {{3435973837UL,  -35, +1},  0.1},
+    {{         2UL, -128, +1},  6e-39},     /* A denormal */
+};
+
+/* get_int32_rounded_f32() in each mode */
+static const struct
+{
+    float   x;
+    int32_t answer[4];          /* Towards zero, down, up, nearest */
+} test_rounding[] =
+{
+    { 2.5,           { 2,          2,          3,          3        }},
+    {-2.5,           {-2,         -3,         -2,         -3        }},
+    { 2.4,           { 2,          2,          3,          2        }},
+    {-0.4,           { 0,         -1,          0,          0        }},
+    { 0.0,           { 0,          0,          0,          0        }},
+    { 1e-20,         { 0,          0,          1,          0        }},
+    { 8388607.5,     { 8388607,    8388607,    8388608,    8388608  }},
+    { 3e9,           { INT32_MAX,  INT32_MAX,  INT32_MAX,  INT32_MAX}},
+    {-2147483648.0,  { INT32_MIN,  INT32_MIN,  INT32_MIN,  INT32_MIN}},
+    {-3e9,           { INT32_MIN,  INT32_MIN,  INT32_MIN,  INT32_MIN}},
+};
+
+/* get_float_bits_f32() rounding halves to even, carrying, overflowing and underflowing */
+static const struct
+{
+    f32_t    x;
+    uint32_t bits;
+} test_float_bits[] =
+{
+    {{0x80000080u, -31,      +1}, 0x3f800000u},     /* 1 + 2^-24, a half, to even       */
+    {{0x80000180u, -31,      +1}, 0x3f800002u},     /* 1 + 3 * 2^-24, a half, to even   */
+    {{0x80000081u, -31,      +1}, 0x3f800001u},     /* Just over a half                 */
+    {{0xffffff80u, -31,      -1}, 0xc0000000u},     /* Rounds up to -2                  */
+    {{UINT32_MAX,  INT8_MAX, +1}, 0x7f800000u},     /* Infinity                         */
+    {{0,           INT8_MIN, -1}, 0x80000000u},     /* -0                               */
+    {{0x80000000u, INT8_MIN, +1}, 0x0f000000u},     /* 2^-97                            */
+    {{1,           INT8_MIN, +1}, 0x00200000u},     /* 2^-128, a float denormal         */
+};
+
+/* get_fix32_from_f32() with a precision, and automatic (-1) */
+static const struct
+{
+    float   x;
+    int     precision;
+    int32_t mantissa;
+    int     answer_precision;
+} test_fix32[] =
+{
+    { 1.5,        24,  25165824,   24},
+    { 1.5,        -1,  1610612736, 30},
+    {-1.0,        -1, -1073741824, 30},
+    {-0.001,      -1, -2147484,    31},
+    { 3.14159265, -1,  1686629760, 29},
+    { 40000.5,    16,  INT32_MAX,  16},
+    { 40000.5,    -1,  1310736384, 15},
+    { 1e10,       -1,  INT32_MAX,   0},
+    { 0.0,        -1,  0,          31},
+};
+
+/* FIX32_CONST() at the edges, where it saturates */
+static const struct
+{
+    fix32_t constant;
+    float   f;
+    int32_t mantissa;
+} test_fix32_const[] =
+{
+    {FIX32_CONST( 0.5,     31),  0.5,     1073741824},
+    {FIX32_CONST( 1.0,     31),  1.0,     INT32_MAX },
+    {FIX32_CONST(-1.0,     31), -1.0,     INT32_MIN },
+    {FIX32_CONST(-1.5,     31), -1.5,     INT32_MIN },
+    {FIX32_CONST( 70000.0, 15),  70000.0, INT32_MAX },
+};
+
+/*
+ * The fix32_t maths routines, answer for answer. These are what they give, each checked to be
+ * within the bounds in fixed_point.c against long double on a PC.
+ */
+static const struct
+{
+    fix32_t x;
+    fix32_t answer;
+} test_square_root_fix32[] =
+{
+    {FIX32_CONST(2.0,     24), { 379625062,  28}},
+    {FIX32_CONST(2.0,     25), { 759250124,  29}},      /* Odd precision, shifted up */
+    {FIX32_CONST(0.25,    30), {1073741824,  31}},
+    {FIX32_CONST(10000.0, 16), {1677721600,  24}},
+    {FIX32_CONST(1.5,     28), {1315059792,  30}},
+    {FIX32_CONST(0.0,     31), {0,           31}},
+}, test_reciprocal_square_root_fix32[] =
+{
+    {FIX32_CONST(2.0,     24), {1518500250,  31}},
+    {FIX32_CONST(0.25,    30), {INT32_MAX,   30}},      /* 2 doesn't fit, so saturates */
+    {FIX32_CONST(100.0,   20), { 214748364,  31}},
+    {FIX32_CONST(4.0,     28), {1073741823,  31}},
+    {FIX32_CONST(0.001,   31), {2122168440,  26}},
+    {FIX32_CONST(0.0,     31), {INT32_MAX,    0}},
+}, test_tangent_fix32[] =
+{
+    {FIX32_CONST( 0.0,           28), {0,           31}},
+    {FIX32_CONST( 0.78539816340, 30), { 1073741825, 30}},
+    {FIX32_CONST(-1.0,           30), {-1672253811, 30}},
+    {FIX32_CONST( 1.5,           30), { 1892660547, 27}},
+    {FIX32_CONST( 10.0,          27), { 1392344274, 31}},
+};
+
+static const struct
+{
+    fix32_t x;
+    fix32_t sine;
+    fix32_t cosine;
+} test_sine_cosine_fix32[] =
+{
+    {FIX32_CONST( 0.0,           28), { 0,          30}, { 1073741824, 30}},
+    {FIX32_CONST( 0.52359877559, 30), { 536870911,  30}, { 929887696,  30}},
+    {FIX32_CONST( 1.57079632679, 30), { 1073741824, 30}, { 0,          30}},
+    {FIX32_CONST(-0.78539816340, 30), {-759250125,  30}, { 759250124,  30}},
+    {FIX32_CONST( 3.14159265359, 29), { 0,          30}, {-1073741824, 30}},
+    {FIX32_CONST( 10.0,          27), {-584138219,  30}, {-900946194,  30}},
+    {FIX32_CONST(-100.0,         24), { 543705966,  30}, { 925907838,  30}},
+};
+
+static const struct
+{
+    fix32_t y;
+    fix32_t x;
+    fix32_t answer;
+} test_arctangent2_fix32[] =
+{
+    {FIX32_CONST( 1.0, 28), FIX32_CONST( 1.0,    28), { 421657428,  29}},
+    {FIX32_CONST( 1.0, 28), FIX32_CONST(-1.0,    28), { 1264972284, 29}},
+    {FIX32_CONST(-1.0, 28), FIX32_CONST( 0.0,    28), {-843314856,  29}},
+    {FIX32_CONST( 0.0, 28), FIX32_CONST(-1.0,    28), { 1686629713, 29}},
+    {FIX32_CONST( 0.5, 30), FIX32_CONST( 2000.0, 20), { 134217,     29}},
+    {FIX32_CONST(-3.0, 28), FIX32_CONST(-4.0,    28), {-1341152685, 29}},
+};
+
 static const struct f_s test_cosine[] = 
 {
     /* x         cosine(x) */
@@ -712,6 +1803,108 @@ static const struct f_s test_cosine[] =
     { 0.785398163, 0.70710678},
     {-0.785398163, 0.70710678},
     {0.00001,      0.9999999999},
+    { 3.14159265, -1.0},
+    { 100.0,       0.862318872},
+    { 1e6,         0.936752128},
+    {-1e30,       -0.611604785},
+};
+
+static const struct f_s test_sine[] = 
+{
+    /* x          sine(x) */
+    { 0.5235987756,  0.500000013  },
+    {-0.5235987756, -0.500000013  },
+    { 3.14159265,   -8.742278e-8  },
+    { 100.0,        -0.506365641  },
+    {-1e6,           0.349993502  },
+    { 1e30,         -0.791163439  },
+    { 1e-20,         9.99999968e-21},
+};
+
+static const struct f_s test_tangent[] = 
+{
+    /* x          tangent(x) */
+    { 0.785398163,  1.00000004},
+    { 1.0,          1.55740772},
+    {-1.0,         -1.55740772},
+    { 1.57,         1255.84831},
+    {-2.0,          2.18503986},
+    { 1000.0,       1.47032416},
+};
+
+static const struct f_s test_exponential[] = 
+{
+    /* x        exponential(x) */
+    {  0.0,     1.0           },
+    {  1.0,     2.71828183    },
+    { -2.5,     0.0820849986  },
+    { 10.0,     22026.4658    },
+    { 88.0,     1.65163625e38 },
+    {-50.0,     1.92874985e-22},
+};
+
+static const struct f_s test_exponential2[] = 
+{
+    /* x        exponential2(x) */
+    {  0.5,     1.41421356    },
+    {-10.0,     0.0009765625  },
+    {100.25,    1.50749911e30 },
+    { -0.001,   0.999307093   },
+};
+
+static const struct f_s test_logarithm[] = 
+{
+    /* x            logarithm(x) */
+    { 2.718281828,  0.99999997   },
+    { 10.0,         2.30258509   },
+    { 1e-20,       -46.0517019   },
+    { 0.999,       -0.00100048745},
+    { 1e30,         69.0775528   },
+};
+
+static const struct f_s test_logarithm2[] = 
+{
+    /* x            logarithm2(x) */
+    { 1024.0,       10.0          },
+    { 3.0,          1.5849625     },
+    { 0.1,         -3.32192807    },
+    { 1.00001,      1.44464703e-5 },
+};
+
+static const struct f_s test_logarithm10[] = 
+{
+    /* x            logarithm10(x) */
+    { 1000.0,       3.0           },
+    { 2.0,          0.301029996   },
+    { 1e-25,       -25.0          },
+    { 0.5,         -0.301029996   },
+};
+
+static const struct yx_s test_power[] =
+{
+    /* x         y         power(x, y) */
+    { 2.0,      10.0,      1024.0      },
+    { 2.0,      0.5,       1.41421356  },
+    {-2.0,      3.0,      -8.0         },
+    { 10.0,    -3.0,       0.001       },
+    { 0.0,      2.0,       0.0         },
+    { 3.7,      2.2,       17.784589   },
+    { 1.0001,   10000.0,   2.71859697  },
+    {-1.5,     -4.0,       0.197530864 },
+};
+
+static const struct yx_s test_arctangent2[] =
+{
+    /* y         x       arctangent2(y, x) */
+    { 1.0,     1.0,     0.785398163},
+    { 1.0,    -1.0,     2.35619449 },
+    {-1.0,    -1.0,    -2.35619449 },
+    {-1.0,     1.0,    -0.785398163},
+    { 0.0,    -1.0,     3.14159265 },
+    { 1.0,     0.0,     1.57079633 },
+    {-2.5,     0.001,  -1.57039633 },
+    { 3e-10,   2.0,     1.49999999e-10},
+    { 1e10,   -3.0,     1.57079633 },
 };
 
 static const struct f_s test_square_root[] = 
@@ -722,8 +1915,34 @@ static const struct f_s test_square_root[] =
     {9.876543e-15, 9.93807979e-8},
 };
 
+/* Denormals and unnormalised values, which have to be normalised first; the sign is ignored */
+static const struct
+{
+    f32_t x;
+    float answer;
+} test_square_root_denormal[] =
+{
+    {{3,           INT8_MIN, +1}, 9.389466242e-20},
+    {{3,           INT8_MIN, -1}, 9.389466242e-20},
+    {{1,           -127,     +1}, 7.666467083e-20},
+    {{0x12345600u, INT8_MIN, +1}, 9.473901273e-16},
+};
+
+static const struct f_s test_reciprocal_square_root[] = 
+{
+    /* x           1 / square_root(x) */
+    { 25600.0,     0.00625       },
+    {9.876543e+15, 1.00623060e-8 },
+    {9.876543e-15, 10062306.0    },
+    { 0.5,         1.41421356    },
+    { 2.0,         0.707106781   },
+};
+
 static const f32_t max_error = {0x80000000, -54, 1};
 
+/* volatile, so that the float round trip really goes through a float */
+static volatile float soft_float;
+
 static bool close_enough(const f32_t *z, const f32_t *a)
 {
     f32_t error;
@@ -773,6 +1992,37 @@ static void check_answer_fif(f32_t *x, int32_t iy, f32_t *z, f32_t *a, const cha
     sleep(10);
 }
 
+static void check_answer_ffff(f32_t *x, f32_t *y, f32_t *w, f32_t *z, f32_t *a)
+{
+    bool pass;
+    
+    pass = close_enough(z, a);
+    
+    dprintf("%s %09f x %09f + %09f = %09f, should be %09f\n", pass ? " PASS" : "*FAIL", x, y, w,
+            z, a);
+    sleep(10);
+}
+
+static void check_answer_int(f32_t *x, int32_t z, int32_t a, const char *op)
+{
+    bool pass;
+
+    pass = z == a;
+
+    dprintf("%s %s %09f = %d, should be %d\n", pass ? " PASS" : "*FAIL", op, x, z, a);
+    sleep(10);
+}
+
+static void check_answer_bits(f32_t *x, uint32_t z, uint32_t a)
+{
+    bool pass;
+
+    pass = z == a;
+
+    dprintf("%s float bits of %09f = %x, should be %x\n", pass ? " PASS" : "*FAIL", x, z, a);
+    sleep(10);
+}
+
 static void check_answer_ff(f32_t *x, f32_t *z, f32_t *a, const char *op)
 {
     bool pass;
@@ -783,10 +2033,46 @@ static void check_answer_ff(f32_t *x, f32_t *z, f32_t *a, const char *op)
     sleep(10);
 }
 
+/* The fix32_t routines should give exactly the answers in the tables */
+static void check_answer_fix32(const fix32_t *x, const fix32_t *z, const fix32_t *a,
+                               const char *op)
+{
+    bool pass;
+    f32_t fx;
+
+    pass = z->mantissa == a->mantissa && z->precision == a->precision;
+    get_f32_from_fix32(&fx, x);
+
+    dprintf("%s %s %09f = %d >> %d, should be %d >> %d\n", pass ? " PASS" : "*FAIL", op, &fx,
+            z->mantissa, z->precision, a->mantissa, a->precision);
+    sleep(10);
+}
+
+/* The array routines should give exactly the answers of the single-value ones */
+static void check_array(const f32_t *z, const f32_t *a, unsigned n, const char *op)
+{
+    bool pass = true;
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (z[i].mantissa != a[i].mantissa || z[i].exponent != a[i].exponent ||
+            (z[i].signum != a[i].signum && z[i].mantissa != 0))
+        {
+            pass = false;
+        }
+    }
+    dprintf("%s %s of %u values\n", pass ? " PASS" : "*FAIL", op, n);
+    sleep(10);
+}
+
 void f32_test(void)
 {
-    int i;
-    f32_t x, y, z, a;
+    int i, j;
+    /* Static, to keep them off the calling task's stack (task1 only has 512 bytes) */
+    static f32_t x, y, z, a, w, vx[4], vy[4];
+    static f32_t ax[TEST_ARRAY_LENGTH], ay[TEST_ARRAY_LENGTH], az[TEST_ARRAY_LENGTH];
+    static f32_t aa[TEST_ARRAY_LENGTH];
     int32_t iy;
     uint32_t ticks1, ticks2;
 
@@ -823,6 +2109,11 @@ void f32_test(void)
         
         check_answer_ffb(&x, &y, is_ge_f32(&x, &y), test_ff[i].x_ge_y, ">=");
         check_answer_ffb(&y, &x, is_ge_f32(&y, &x), test_ff[i].y_ge_x, ">=");
+
+        reciprocal_f32(&z, &y);
+        multiply_f32(&z, &x, &z);
+        get_f32_from_float(&a, test_ff[i].x_over_y);
+        check_answer_fff(&x, &y, &z, &a, "x 1/");
     }
 
     for (i = 0; i < sizeof(test_fi) / sizeof(test_fi[0]); ++i)
@@ -847,6 +2138,243 @@ void f32_test(void)
         check_answer_fif(&x, iy, &z, &a, "-");
     }
     
+    for (i = 0; i < sizeof(test_multiply_add) / sizeof(test_multiply_add[0]); ++i)
+    {
+        get_f32_from_float(&x, test_multiply_add[i].x);
+        get_f32_from_float(&y, test_multiply_add[i].y);
+        get_f32_from_float(&w, test_multiply_add[i].w);
+        multiply_add_f32(&z, &x, &y, &w);
+        get_f32_from_float(&a, test_multiply_add[i].answer);
+        check_answer_ffff(&x, &y, &w, &z, &a);
+    }
+
+    for (j = 0; j < 4; ++j)
+    {
+        get_f32_from_float(&vy[j], test_dot_y[j]);
+    }
+    for (i = 0; i < sizeof(test_dot_answer) / sizeof(test_dot_answer[0]); ++i)
+    {
+        for (j = 0; j < 4; ++j)
+        {
+            get_f32_from_float(&vx[j], test_dot_x[i][j]);
+        }
+        dot_product_f32(&z, vx, vy, 4);
+        get_f32_from_float(&a, test_dot_answer[i]);
+        check_answer_ff(&vx[0], &z, &a, "dot product from");
+    }
+
+    /* 2^-50 squared is 2^-100, a denormal (2^28 at exponent -128) whichever way it's worked out */
+    make_f32(&x, 1, -50);
+    normalise_f32(&x);
+    multiply_f32(&z, &x, &x);
+    check_answer_int(&x, z.mantissa, 1u << 28, "denormal mantissa of square of");
+    check_answer_int(&x, z.exponent, INT8_MIN, "denormal exponent of square of");
+    multiply_add_f32(&z, &x, &x, &plus_zero);
+    check_answer_int(&x, z.mantissa, 1u << 28, "denormal mantissa of multiply_add of");
+    vx[0] = vx[1] = x;
+    dot_product_f32(&z, vx, vx, 2);
+    check_answer_int(&x, z.mantissa, 1u << 29, "denormal mantissa of dot product of");
+    check_answer_int(&x, z.exponent, INT8_MIN, "denormal exponent of dot product of");
+
+    for (i = 0; i < sizeof(test_constants) / sizeof(test_constants[0]); ++i)
+    {
+        x = test_constants[i].constant;
+        get_f32_from_float(&a, test_constants[i].f);
+        check_answer_ff(&x, &x, &a, "constant");
+    }
+
+    for (i = 0; i < sizeof(test_rounding) / sizeof(test_rounding[0]); ++i)
+    {
+        get_f32_from_float(&x, test_rounding[i].x);
+        check_answer_int(&x, get_int32_f32(&x), test_rounding[i].answer[ROUND_TOWARDS_ZERO],
+                         "integer");
+        check_answer_int(&x, get_int32_rounded_f32(&x, ROUND_DOWN),
+                         test_rounding[i].answer[ROUND_DOWN], "integer rounded down");
+        check_answer_int(&x, get_int32_rounded_f32(&x, ROUND_UP),
+                         test_rounding[i].answer[ROUND_UP], "integer rounded up");
+        check_answer_int(&x, get_int32_rounded_f32(&x, ROUND_NEAREST),
+                         test_rounding[i].answer[ROUND_NEAREST], "integer rounded to nearest");
+    }
+
+    for (i = 0; i < sizeof(test_float_bits) / sizeof(test_float_bits[0]); ++i)
+    {
+        x = test_float_bits[i].x;
+        check_answer_bits(&x, get_float_bits_f32(&x), test_float_bits[i].bits);
+    }
+    /* Every float in test_ff should come back exactly */
+    for (i = 0; i < sizeof(test_ff) / sizeof(test_ff[0]); ++i)
+    {
+        get_f32_from_float(&x, test_ff[i].y);
+        soft_float = get_float_f32(&x);
+        get_f32_from_float(&z, soft_float);
+        check_answer_bits(&x, get_float_bits_f32(&z), get_float_bits_f32(&x));
+        check_answer_int(&x, soft_float == test_ff[i].y, true, "same float as");
+    }
+
+    for (i = 0; i < sizeof(test_fix32) / sizeof(test_fix32[0]); ++i)
+    {
+        fix32_t fx;
+
+        get_f32_from_float(&x, test_fix32[i].x);
+        get_fix32_from_f32(&fx, &x, test_fix32[i].precision);
+        check_answer_int(&x, fx.mantissa, test_fix32[i].mantissa, "fix32 mantissa from");
+        check_answer_int(&x, fx.precision, test_fix32[i].answer_precision, "fix32 precision for");
+        if (fx.mantissa != INT32_MAX)
+        {
+            get_f32_from_fix32(&z, &fx);
+            check_answer_ff(&x, &z, &x, "fix32 and back");
+        }
+    }
+
+    for (i = 0; i < sizeof(test_fix32_const) / sizeof(test_fix32_const[0]); ++i)
+    {
+        get_f32_from_float(&x, test_fix32_const[i].f);
+        check_answer_int(&x, test_fix32_const[i].constant.mantissa, test_fix32_const[i].mantissa,
+                         "FIX32_CONST mantissa of");
+    }
+
+    for (i = 0; i < sizeof(test_square_root_fix32) / sizeof(test_square_root_fix32[0]); ++i)
+    {
+        fix32_t fz;
+
+        square_root_fix32(&fz, &test_square_root_fix32[i].x);
+        check_answer_fix32(&test_square_root_fix32[i].x, &fz, &test_square_root_fix32[i].answer,
+                           "square_root_fix32");
+    }
+    for (i = 0; i < sizeof(test_reciprocal_square_root_fix32) /
+                    sizeof(test_reciprocal_square_root_fix32[0]); ++i)
+    {
+        fix32_t fz;
+
+        reciprocal_square_root_fix32(&fz, &test_reciprocal_square_root_fix32[i].x);
+        check_answer_fix32(&test_reciprocal_square_root_fix32[i].x, &fz,
+                           &test_reciprocal_square_root_fix32[i].answer,
+                           "reciprocal_square_root_fix32");
+    }
+    for (i = 0; i < sizeof(test_sine_cosine_fix32) / sizeof(test_sine_cosine_fix32[0]); ++i)
+    {
+        fix32_t fs, fc;
+
+        sine_fix32(&fs, &test_sine_cosine_fix32[i].x);
+        check_answer_fix32(&test_sine_cosine_fix32[i].x, &fs, &test_sine_cosine_fix32[i].sine,
+                           "sine_fix32");
+        cosine_fix32(&fc, &test_sine_cosine_fix32[i].x);
+        check_answer_fix32(&test_sine_cosine_fix32[i].x, &fc, &test_sine_cosine_fix32[i].cosine,
+                           "cosine_fix32");
+        sine_cosine_fix32(&fs, &fc, &test_sine_cosine_fix32[i].x);
+        check_answer_fix32(&test_sine_cosine_fix32[i].x, &fs, &test_sine_cosine_fix32[i].sine,
+                           "sine_cosine_fix32 sine");
+        check_answer_fix32(&test_sine_cosine_fix32[i].x, &fc, &test_sine_cosine_fix32[i].cosine,
+                           "sine_cosine_fix32 cosine");
+    }
+    for (i = 0; i < sizeof(test_tangent_fix32) / sizeof(test_tangent_fix32[0]); ++i)
+    {
+        fix32_t fz;
+
+        tangent_fix32(&fz, &test_tangent_fix32[i].x);
+        check_answer_fix32(&test_tangent_fix32[i].x, &fz, &test_tangent_fix32[i].answer,
+                           "tangent_fix32");
+    }
+    /* Printed against y; x is in the table */
+    for (i = 0; i < sizeof(test_arctangent2_fix32) / sizeof(test_arctangent2_fix32[0]); ++i)
+    {
+        fix32_t fz;
+
+        arctangent2_fix32(&fz, &test_arctangent2_fix32[i].y, &test_arctangent2_fix32[i].x);
+        check_answer_fix32(&test_arctangent2_fix32[i].y, &fz, &test_arctangent2_fix32[i].answer,
+                           "arctangent2_fix32 of y");
+    }
+
+    /* The arrays are the x and y columns of test_ff */
+    for (i = 0; i < TEST_ARRAY_LENGTH; ++i)
+    {
+        get_f32_from_float(&ax[i], test_ff[i].x);
+        get_f32_from_float(&ay[i], test_ff[i].y);
+    }
+    load_soa_f32(&test_soa_x, ax, TEST_ARRAY_LENGTH);
+    load_soa_f32(&test_soa_y, ay, TEST_ARRAY_LENGTH);
+
+    for (i = 0; i < TEST_ARRAY_LENGTH; ++i)
+    {
+        add_f32(&aa[i], &ax[i], &ay[i]);
+    }
+    add_array_f32(az, ax, ay, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "array add");
+    add_soa_f32(&test_soa_z, &test_soa_x, &test_soa_y, TEST_ARRAY_LENGTH);
+    store_soa_f32(az, &test_soa_z, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "structure of arrays add");
+
+    for (i = 0; i < TEST_ARRAY_LENGTH; ++i)
+    {
+        subtract_f32(&aa[i], &ax[i], &ay[i]);
+    }
+    subtract_array_f32(az, ax, ay, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "array subtract");
+    subtract_soa_f32(&test_soa_z, &test_soa_x, &test_soa_y, TEST_ARRAY_LENGTH);
+    store_soa_f32(az, &test_soa_z, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "structure of arrays subtract");
+
+    for (i = 0; i < TEST_ARRAY_LENGTH; ++i)
+    {
+        multiply_f32(&aa[i], &ax[i], &ay[i]);
+    }
+    multiply_array_f32(az, ax, ay, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "array multiply");
+    multiply_soa_f32(&test_soa_z, &test_soa_x, &test_soa_y, TEST_ARRAY_LENGTH);
+    store_soa_f32(az, &test_soa_z, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "structure of arrays multiply");
+
+    for (i = 0; i < TEST_ARRAY_LENGTH; ++i)
+    {
+        multiply_f32(&aa[i], &ax[i], &root_2);
+    }
+    scale_array_f32(az, ax, &root_2, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "array scale");
+    scale_soa_f32(&test_soa_z, &test_soa_x, &root_2, TEST_ARRAY_LENGTH);
+    store_soa_f32(az, &test_soa_z, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "structure of arrays scale");
+
+    /* acc = x, then acc += x * y */
+    for (i = 0; i < TEST_ARRAY_LENGTH; ++i)
+    {
+        multiply_add_f32(&aa[i], &ax[i], &ay[i], &ax[i]);
+        az[i] = ax[i];
+    }
+    multiply_accumulate_array_f32(az, ax, ay, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "array multiply-accumulate");
+    load_soa_f32(&test_soa_z, ax, TEST_ARRAY_LENGTH);
+    multiply_accumulate_soa_f32(&test_soa_z, &test_soa_x, &test_soa_y, TEST_ARRAY_LENGTH);
+    store_soa_f32(az, &test_soa_z, TEST_ARRAY_LENGTH);
+    check_array(az, aa, TEST_ARRAY_LENGTH, "structure of arrays multiply-accumulate");
+
+    /* The x column cancels down to its first value, which needs the whole sum */
+    sum_array_f32(&z, ax, TEST_ARRAY_LENGTH);
+    check_answer_ff(&ax[0], &z, &ax[0], "array sum from");
+    sum_soa_f32(&z, &test_soa_x, TEST_ARRAY_LENGTH);
+    check_answer_ff(&ax[0], &z, &ax[0], "structure of arrays sum from");
+    min_array_f32(&z, ax, TEST_ARRAY_LENGTH);
+    check_answer_ff(&ax[0], &z, &ax[3], "array min from");
+    min_soa_f32(&z, &test_soa_x, TEST_ARRAY_LENGTH);
+    check_answer_ff(&ax[0], &z, &ax[3], "structure of arrays min from");
+    max_array_f32(&z, ay, TEST_ARRAY_LENGTH);
+    check_answer_ff(&ay[0], &z, &ay[0], "array max from");
+    max_soa_f32(&z, &test_soa_y, TEST_ARRAY_LENGTH);
+    check_answer_ff(&ay[0], &z, &ay[0], "structure of arrays max from");
+
+    /* Packing keeps 24 bits of mantissa, within max_error */
+    pack_array_f32(test_packed, ax, TEST_ARRAY_LENGTH);
+    unpack_array_f32(az, test_packed, TEST_ARRAY_LENGTH);
+    for (i = 0; i < TEST_ARRAY_LENGTH; ++i)
+    {
+        check_answer_ff(&ax[i], &az[i], &ax[i], "packed and unpacked");
+    }
+    for (i = 0; i < sizeof(test_packing) / sizeof(test_packing[0]); ++i)
+    {
+        x = test_packing[i];
+        get_f32_from_packed(&z, get_packed_f32(&x));
+        check_answer_ff(&x, &z, &x, "packed and unpacked");
+    }
+
     for (i = 0; i < sizeof(test_cosine) / sizeof(test_cosine[0]); ++i)
     {
         get_f32_from_float(&x, test_cosine[i].x);
@@ -855,6 +2383,81 @@ void f32_test(void)
         check_answer_ff(&x, &z, &a, "cosine");
     }
 
+    for (i = 0; i < sizeof(test_sine) / sizeof(test_sine[0]); ++i)
+    {
+        get_f32_from_float(&x, test_sine[i].x);
+        sine_f32(&z, &x);
+        get_f32_from_float(&a, test_sine[i].answer);
+        check_answer_ff(&x, &z, &a, "sine");
+    }
+
+    for (i = 0; i < sizeof(test_tangent) / sizeof(test_tangent[0]); ++i)
+    {
+        get_f32_from_float(&x, test_tangent[i].x);
+        tangent_f32(&z, &x);
+        get_f32_from_float(&a, test_tangent[i].answer);
+        check_answer_ff(&x, &z, &a, "tangent");
+    }
+
+    for (i = 0; i < sizeof(test_arctangent2) / sizeof(test_arctangent2[0]); ++i)
+    {
+        get_f32_from_float(&y, test_arctangent2[i].y);
+        get_f32_from_float(&x, test_arctangent2[i].x);
+        arctangent2_f32(&z, &y, &x);
+        get_f32_from_float(&a, test_arctangent2[i].answer);
+        check_answer_fff(&y, &x, &z, &a, "atan2");
+    }
+
+    for (i = 0; i < sizeof(test_exponential) / sizeof(test_exponential[0]); ++i)
+    {
+        get_f32_from_float(&x, test_exponential[i].x);
+        exponential_f32(&z, &x);
+        get_f32_from_float(&a, test_exponential[i].answer);
+        check_answer_ff(&x, &z, &a, "exponential");
+    }
+
+    for (i = 0; i < sizeof(test_exponential2) / sizeof(test_exponential2[0]); ++i)
+    {
+        get_f32_from_float(&x, test_exponential2[i].x);
+        exponential2_f32(&z, &x);
+        get_f32_from_float(&a, test_exponential2[i].answer);
+        check_answer_ff(&x, &z, &a, "exponential2");
+    }
+
+    for (i = 0; i < sizeof(test_logarithm) / sizeof(test_logarithm[0]); ++i)
+    {
+        get_f32_from_float(&x, test_logarithm[i].x);
+        logarithm_f32(&z, &x);
+        get_f32_from_float(&a, test_logarithm[i].answer);
+        check_answer_ff(&x, &z, &a, "logarithm");
+    }
+
+    for (i = 0; i < sizeof(test_logarithm2) / sizeof(test_logarithm2[0]); ++i)
+    {
+        get_f32_from_float(&x, test_logarithm2[i].x);
+        logarithm2_f32(&z, &x);
+        get_f32_from_float(&a, test_logarithm2[i].answer);
+        check_answer_ff(&x, &z, &a, "logarithm2");
+    }
+
+    for (i = 0; i < sizeof(test_logarithm10) / sizeof(test_logarithm10[0]); ++i)
+    {
+        get_f32_from_float(&x, test_logarithm10[i].x);
+        logarithm10_f32(&z, &x);
+        get_f32_from_float(&a, test_logarithm10[i].answer);
+        check_answer_ff(&x, &z, &a, "logarithm10");
+    }
+
+    /* Uses the y, x, answer layout, but is x^y */
+    for (i = 0; i < sizeof(test_power) / sizeof(test_power[0]); ++i)
+    {
+        get_f32_from_float(&x, test_power[i].y);
+        get_f32_from_float(&y, test_power[i].x);
+        power_f32(&z, &x, &y);
+        get_f32_from_float(&a, test_power[i].answer);
+        check_answer_fff(&x, &y, &z, &a, "^");
+    }
+
     for (i = 0; i < sizeof(test_square_root) / sizeof(test_square_root[0]); ++i)
     {
         get_f32_from_float(&x, test_square_root[i].x);
@@ -862,10 +2465,25 @@ void f32_test(void)
         get_f32_from_float(&a, test_square_root[i].answer);
         check_answer_ff(&x, &z, &a, "square_root");
     }
+    for (i = 0; i < sizeof(test_square_root_denormal) / sizeof(test_square_root_denormal[0]); ++i)
+    {
+        x = test_square_root_denormal[i].x;
+        square_root_f32(&z, &x);
+        get_f32_from_float(&a, test_square_root_denormal[i].answer);
+        check_answer_ff(&x, &z, &a, "square_root");
+    }
+
+    for (i = 0; i < sizeof(test_reciprocal_square_root) / sizeof(test_reciprocal_square_root[0]); ++i)
+    {
+        get_f32_from_float(&x, test_reciprocal_square_root[i].x);
+        reciprocal_square_root_f32(&z, &x);
+        get_f32_from_float(&a, test_reciprocal_square_root[i].answer);
+        check_answer_ff(&x, &z, &a, "reciprocal_square_root");
+    }
 
     
-    ticks1 = ticks;
-    while (ticks1 == ticks);
+    /* Start each timing at a tick. Sleeping, not spinning, lets the other tasks keep up. */
+    sleep(1);
     ticks1 = ticks;
     for (i = 0; i < 32000; ++i)
     {
@@ -873,9 +2491,8 @@ void f32_test(void)
     }
     ticks2 = ticks;
     dprintf("Add took %u ticks\n", ticks2 - ticks1);
-    
-    ticks1 = ticks;
-    while (ticks1 == ticks);
+
+    sleep(1);
     ticks1 = ticks;
     for (i = 0; i < 32000; ++i)
     {
@@ -883,9 +2500,8 @@ void f32_test(void)
     }
     ticks2 = ticks;
     dprintf("Multiply took %u ticks\n", ticks2 - ticks1);
-    
-    ticks1 = ticks;
-    while (ticks1 == ticks);
+
+    sleep(1);
     ticks1 = ticks;
     for (i = 0; i < 32000; ++i)
     {
@@ -894,8 +2510,7 @@ void f32_test(void)
     ticks2 = ticks;
     dprintf("Divide took %u ticks\n", ticks2 - ticks1);
 
-    ticks1 = ticks;
-    while (ticks1 == ticks);
+    sleep(1);
     ticks1 = ticks;
     for (i = 0; i < 32000; ++i)
     {
@@ -903,6 +2518,5 @@ void f32_test(void)
     }
     ticks2 = ticks;
     dprintf("Square root took %u ticks\n", ticks2 - ticks1);
-
 }
 #endif /* INCLUDE_F32_TESTS */
@@ -13,6 +13,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "fixed_point.h"
 
 /*
  * A floating-point number is stored as an unsigned 32-bit mantissa,
@@ -28,6 +29,10 @@ typedef struct
     int8_t   signum;
 } f32_t;
 
+/*
+ * For constants, there's no need to convert at run time: host/f32_const.c prints initialisers
+ * for const tables, e.g. ./f32_const 1.5 gives {3221225472UL, -31, +1}
+ */
 extern void get_f32_from_float(f32_t *a, float f);
 extern void normalise_f32(f32_t *a);
 
@@ -55,6 +60,137 @@ extern void   divide_f32(f32_t *ret, const f32_t *a, const f32_t *b);
 extern void      add_f32(f32_t *ret, const f32_t *a, const f32_t *b);
 extern void subtract_f32(f32_t *ret, const f32_t *a, const f32_t *b);
 
+/*
+ * ret = a * b + c, and the sum of a[i] * b[i] for i from 0 to n - 1
+ * These keep a 62-bit sum and normalise once at the end, which is quicker and more accurate
+ * than multiply_f32() followed by add_f32().
+ */
+extern void multiply_add_f32(f32_t *ret, const f32_t *a, const f32_t *b, const f32_t *c);
+extern void  dot_product_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n);
+
+/*
+ * The same for arrays of n values, e.g. ret[i] = a[i] + b[i] for i from 0 to n - 1, without a
+ * call per value. The answers are exactly those of the single-value routines. ret can be a or b.
+ */
+extern void      add_array_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n);
+extern void subtract_array_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n);
+extern void multiply_array_f32(f32_t *ret, const f32_t *a, const f32_t *b, unsigned n);
+extern void    scale_array_f32(f32_t *ret, const f32_t *a, const f32_t *k, unsigned n);   /* a[i] * k */
+extern void multiply_accumulate_array_f32(f32_t *acc, const f32_t *a, const f32_t *b, unsigned n);
+
+/*
+ * ret = the sum (to 62 bits, as dot_product_f32()), the smallest or the largest of a[0] to
+ * a[n - 1]. With no values, the sum is zero, the smallest +infinity and the largest -infinity.
+ */
+extern void sum_array_f32(f32_t *ret, const f32_t *a, unsigned n);
+extern void min_array_f32(f32_t *ret, const f32_t *a, unsigned n);
+extern void max_array_f32(f32_t *ret, const f32_t *a, unsigned n);
+
+/*
+ * A structure of arrays, holding the mantissas, exponents and signs of an array of values in
+ * three separate arrays. That takes 6 bytes a value instead of the 8 of a padded f32_t. Declare
+ * one at compile time with
+ *     DECLARE_F32_SOA(samples, 256);
+ */
+typedef struct
+{
+    uint32_t *mantissa;
+    int8_t   *exponent;
+    int8_t   *signum;
+    unsigned  length;
+} f32_soa_t;
+
+#define DECLARE_F32_SOA(soa_name, soa_length)           \
+static uint32_t soa_name##_mantissa_[soa_length];       \
+static int8_t   soa_name##_exponent_[soa_length];       \
+static int8_t   soa_name##_signum_[soa_length];         \
+f32_soa_t soa_name = {soa_name##_mantissa_, soa_name##_exponent_, soa_name##_signum_, soa_length}
+
+static __inline void get_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned i)
+{
+    ret->mantissa = a->mantissa[i];
+    ret->exponent = a->exponent[i];
+    ret->signum   = a->signum[i];
+}
+
+static __inline void set_soa_f32(f32_soa_t *ret, unsigned i, const f32_t *a)
+{
+    ret->mantissa[i] = a->mantissa;
+    ret->exponent[i] = a->exponent;
+    ret->signum[i]   = a->signum;
+}
+
+/*
+ * Copy n values into or out of a structure of arrays, then the same arithmetic as on arrays.
+ * n must be no more than the length of any of them.
+ */
+extern void  load_soa_f32(f32_soa_t *ret, const f32_t *a, unsigned n);
+extern void store_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n);
+extern void      add_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_soa_t *b, unsigned n);
+extern void subtract_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_soa_t *b, unsigned n);
+extern void multiply_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_soa_t *b, unsigned n);
+extern void    scale_soa_f32(f32_soa_t *ret, const f32_soa_t *a, const f32_t *k, unsigned n);
+extern void multiply_accumulate_soa_f32(f32_soa_t *acc, const f32_soa_t *a, const f32_soa_t *b,
+                                        unsigned n);
+extern void sum_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n);
+extern void min_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n);
+extern void max_soa_f32(f32_t *ret, const f32_soa_t *a, unsigned n);
+
+/*
+ * A value packed into 32 bits, half the size of an f32_t, for storing tables and buffers:
+ *     bit 31      sign, set if negative
+ *     bits 30-23  exponent + 128
+ *     bits 22-0   the mantissa below its top bit, truncated to 23 bits
+ * As in an IEEE float the top bit isn't stored, except with exponent -128 (zero, and the very
+ * smallest values) where it is bits 22-0 that hold the top 23 bits of the mantissa. Packing
+ * loses the bottom 8 bits of the mantissa, less than 1 part in 2^23.
+ */
+typedef uint32_t packed_f32_t;
+
+static __inline packed_f32_t get_packed_f32(const f32_t *a)
+{
+    packed_f32_t sign = (a->signum < 0) ? 0x80000000u : 0;
+    f32_t b;
+
+    if ((a->mantissa & 0x80000000u) == 0 && a->exponent != INT8_MIN)
+    {
+        b = *a;
+        normalise_f32(&b);
+        a = &b;
+    }
+    if (a->exponent == INT8_MIN)
+    {
+        return sign | (a->mantissa >> 9);
+    }
+    return sign | ((packed_f32_t)(a->exponent + 128) << 23) | ((a->mantissa >> 8) & 0x007fffffu);
+}
+
+static __inline void get_f32_from_packed(f32_t *ret, packed_f32_t a)
+{
+    unsigned exponent = (a >> 23) & 0xff;
+
+    ret->signum = (a & 0x80000000u) ? -1 : 1;
+    if (exponent == 0)
+    {
+        ret->mantissa = (a & 0x007fffffu) << 9;
+        ret->exponent = INT8_MIN;
+    }
+    else
+    {
+        ret->mantissa = (a << 8) | 0x80000000u;
+        ret->exponent = (int)exponent - 128;
+    }
+}
+
+extern void   pack_array_f32(packed_f32_t *ret, const f32_t *a, unsigned n);
+extern void unpack_array_f32(f32_t *ret, const packed_f32_t *a, unsigned n);
+
+/*
+ * ret = 1 / a, with the mantissa rounded down
+ * Multiplying by a reciprocal is much quicker than dividing, for repeated divisions by one value.
+ */
+extern void reciprocal_f32(f32_t *ret, const f32_t *a);
+
 /* 
  * These routines are the same, but the 'b' argument is an int32_t instead of a
  * pointer to a floating-point number.
@@ -65,17 +201,37 @@ extern void      iadd_f32(f32_t *ret, const f32_t *a, int32_t b);
 
 /*
  * Trigonometric routines
- * Angle must be between -pi/2 and pi/2
+ * Angles are in radians, and can be any size
  */
+extern void sine_f32(f32_t *ret, const f32_t *a);
 extern void cosine_f32(f32_t *ret, const f32_t *a);
+extern void sine_cosine_f32(f32_t *sine, f32_t *cosine, const f32_t *a);
+extern void tangent_f32(f32_t *ret, const f32_t *a);
+extern void arctangent2_f32(f32_t *ret, const f32_t *y, const f32_t *x);
+
+/*
+ * Exponentials and logarithms
+ * e^a, 2^a, ln(a), log2(a), log10(a) and x^y. Answers out of range saturate, or go to zero.
+ */
+extern void exponential_f32(f32_t *ret, const f32_t *a);
+extern void exponential2_f32(f32_t *ret, const f32_t *a);
+extern void logarithm_f32(f32_t *ret, const f32_t *a);
+extern void logarithm2_f32(f32_t *ret, const f32_t *a);
+extern void logarithm10_f32(f32_t *ret, const f32_t *a);
+extern void power_f32(f32_t *ret, const f32_t *x, const f32_t *y);
 
 /* Utility functions */
 
 /*
- * Return the square root of a floating point number
+ * Return the square root of a floating point number, to within 1.5 in the last place
  */
 extern void square_root_f32(f32_t *ret, const f32_t *a);
 
+/*
+ * Return 1 / the square root of a floating point number, to within 2 in the last place
+ */
+extern void reciprocal_square_root_f32(f32_t *ret, const f32_t *a);
+
 /*
  * Return the absolute value of a floating-point number
  */
@@ -88,6 +244,7 @@ extern bool is_ge_f32(const f32_t *a, const f32_t *b);
 
 /*
  * Create a floatingpoint number, specifying the mantissa and exponent
+ * make_f32(a, i, 0) converts the integer i exactly.
  */
 static __inline void make_f32(f32_t *a, int32_t mantissa, int exponent)
 {
@@ -98,7 +255,7 @@ static __inline void make_f32(f32_t *a, int32_t mantissa, int exponent)
     }
     else
     {
-        a->mantissa = -mantissa;
+        a->mantissa = 0u - (uint32_t)mantissa;     /* Which works for INT32_MIN too */
         a->signum   = -1;
     }
     a->exponent = exponent;
@@ -107,9 +264,40 @@ static __inline void make_f32(f32_t *a, int32_t mantissa, int exponent)
 }
 
 /*
- * Convert a floating point number to an integer, truncating at the binary point
+ * Conversions to and from other formats, all done with integer arithmetic, so without the
+ * C library's soft-float routines
+ */
+typedef enum
+{
+    ROUND_TOWARDS_ZERO,
+    ROUND_DOWN,                 /* Towards -infinity                */
+    ROUND_UP,                   /* Towards +infinity                */
+    ROUND_NEAREST               /* With halves rounded away from zero */
+} round_mode_t;
+
+/*
+ * Convert to an integer, truncating at the binary point, or rounding as chosen. Numbers beyond
+ * the range of an int32_t saturate to INT32_MAX or INT32_MIN.
+ */
+extern int32_t get_int32_f32(const f32_t *a);
+extern int32_t get_int32_rounded_f32(const f32_t *a, round_mode_t mode);
+
+/*
+ * To and from the 32 bits of an IEEE single precision float. Going to a float rounds to nearest
+ * (halves to even), and anything bigger than a float becomes infinity. Going from one, values
+ * too small for an f32_t (under about 2^-97) lose bits or become zero, and infinity and NaN
+ * saturate.
+ */
+extern uint32_t get_float_bits_f32(const f32_t *a);
+extern void get_f32_from_float_bits(f32_t *ret, uint32_t bits);
+extern float get_float_f32(const f32_t *a);
+
+/*
+ * To and from a fix32_t. The fix32_t is rounded to nearest, with precision bits after the binary
+ * point, or -1 for the most that fit. If it doesn't fit, it saturates.
  */
-extern int32_t get_int32(const f32_t *a);
+extern void get_f32_from_fix32(f32_t *ret, const fix32_t *a);
+extern void get_fix32_from_f32(fix32_t *ret, const f32_t *a, int precision);
 
 static __inline int is_negative_f32(const f32_t *a)
 {
@@ -0,0 +1,30 @@
+/*
+ * Stand-in for the CMSIS compiler header when building m0rtos for a POSIX host.
+ * Put this directory first on the include path (gcc -Ihost -I.) so it is found
+ * instead of the real one.
+ */
+#ifndef _HOST_CMSIS_ARMCC_H
+#define _HOST_CMSIS_ARMCC_H
+
+#include <stdint.h>
+
+#define M0RTOS_HOST
+
+#define __ALIGNED(x)        __attribute__((aligned(x)))
+#define __NO_RETURN         __attribute__((noreturn))
+#define __STATIC_INLINE     static inline
+
+/* A host task stack also holds the saved ucontext_t, so needs to be much bigger */
+#define IDLE_TASK_STACK_WORDS   4096
+
+/* PRIMASK, WFI and barriers, provided by the host port (m0rtos_host.c or m0rtos_vsim.c) */
+extern void host_disable_irq(void);
+extern void host_enable_irq(void);
+extern void host_wait_for_irq(void);
+
+#define __disable_irq()     host_disable_irq()
+#define __enable_irq()      host_enable_irq()
+#define __WFI()             host_wait_for_irq()
+#define __DSB()             __sync_synchronize()
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * edf_sim.c
+ *
+ * Host simulation comparing rate-monotonic (fixed priority) and earliest-deadline-first
+ * scheduling of synthetic periodic task sets at 70-95% CPU utilisation.
+ *
+ * Build and run on the host:
+ *     gcc -O2 -o edf_sim host/edf_sim.c -lm && ./edf_sim
+ *
+ * Each task set has NUM_TASKS tasks with periods between MIN_PERIOD and MAX_PERIOD ticks,
+ * implicit deadlines (deadline = period) and utilisations drawn with UUniFast. The scheduler is
+ * fully pre-emptive with one tick granularity, like m0rtos. Late jobs keep running until
+ * complete, and each job that finishes after its deadline counts as one miss.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#define NUM_TASKS       6
+#define NUM_SETS        200
+#define MIN_PERIOD      10
+#define MAX_PERIOD      200
+#define SIM_TICKS       100000
+
+typedef struct
+{
+    uint32_t period;
+    uint32_t wcet;
+    uint32_t release;           /* Release time of the current job        */
+    uint32_t remaining;         /* Execution ticks left in current job    */
+    uint32_t backlog;           /* Jobs released but not yet started      */
+    uint32_t jobs;
+    uint32_t misses;
+} sim_task_t;
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng(void)
+{
+    /* xorshift32 - deterministic so runs are repeatable */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double rng_uniform(void)
+{
+    return (rng() + 0.5) / 4294967296.0;
+}
+
+/*
+ * Generate a task set with the given total utilisation
+ * Returns the utilisation actually achieved after rounding execution times down to whole ticks
+ */
+static double make_task_set(sim_task_t *tasks, double utilisation)
+{
+    double sum = utilisation, next, u, actual = 0.0;
+    int i;
+
+    for (i = 0; i < NUM_TASKS; ++i)
+    {
+        /* UUniFast */
+        if (i < NUM_TASKS - 1)
+        {
+            next = sum * pow(rng_uniform(), 1.0 / (NUM_TASKS - 1 - i));
+            u = sum - next;
+            sum = next;
+        }
+        else
+        {
+            u = sum;
+        }
+        tasks[i].period = MIN_PERIOD + rng() % (MAX_PERIOD - MIN_PERIOD + 1);
+        tasks[i].wcet   = (uint32_t)(u * tasks[i].period);
+        if (tasks[i].wcet == 0)
+        {
+            tasks[i].wcet = 1;
+        }
+        actual += (double)tasks[i].wcet / tasks[i].period;
+    }
+    return actual;
+}
+
+/*
+ * Run one task set for SIM_TICKS ticks, returning the total number of deadline misses
+ */
+static uint32_t simulate(sim_task_t *tasks, bool edf, uint32_t *jobs)
+{
+    uint32_t now, deadline, best_key, key, misses = 0;
+    int i, best;
+
+    for (i = 0; i < NUM_TASKS; ++i)
+    {
+        tasks[i].release   = 0;
+        tasks[i].remaining = tasks[i].wcet;
+        tasks[i].backlog   = 0;
+        tasks[i].jobs      = 1;
+        tasks[i].misses    = 0;
+    }
+
+    for (now = 0; now < SIM_TICKS; ++now)
+    {
+        /* Release new jobs */
+        for (i = 0; i < NUM_TASKS; ++i)
+        {
+            if (now > 0 && now % tasks[i].period == 0)
+            {
+                ++tasks[i].jobs;
+                if (tasks[i].remaining == 0)
+                {
+                    tasks[i].release   = now;
+                    tasks[i].remaining = tasks[i].wcet;
+                }
+                else
+                {
+                    ++tasks[i].backlog;
+                }
+            }
+        }
+
+        /* Pick a job: shortest period for RM, earliest absolute deadline for EDF */
+        best = -1;
+        best_key = UINT32_MAX;
+        for (i = 0; i < NUM_TASKS; ++i)
+        {
+            if (tasks[i].remaining == 0)
+            {
+                continue;
+            }
+            key = edf ? tasks[i].release + tasks[i].period : tasks[i].period;
+            if (key < best_key)
+            {
+                best_key = key;
+                best = i;
+            }
+        }
+        if (best < 0)
+        {
+            continue;
+        }
+
+        /* Run it for one tick */
+        if (--tasks[best].remaining == 0)
+        {
+            deadline = tasks[best].release + tasks[best].period;
+            if (now + 1 > deadline)
+            {
+                ++tasks[best].misses;
+            }
+            if (tasks[best].backlog)
+            {
+                --tasks[best].backlog;
+                tasks[best].release  += tasks[best].period;
+                tasks[best].remaining = tasks[best].wcet;
+            }
+        }
+    }
+
+    *jobs = 0;
+    for (i = 0; i < NUM_TASKS; ++i)
+    {
+        misses += tasks[i].misses;
+        *jobs  += tasks[i].jobs;
+    }
+    return misses;
+}
+
+int main(void)
+{
+    sim_task_t tasks[NUM_TASKS];
+    uint32_t rm_misses, edf_misses, rm_sets, edf_sets, jobs, total_jobs, m;
+    double target, actual, u;
+    int percent, set;
+
+    printf("target_util,mean_util,sets,jobs,rm_sets_missing,rm_misses,edf_sets_missing,edf_misses\n");
+    for (percent = 70; percent <= 95; percent += 5)
+    {
+        target = percent / 100.0;
+        rm_misses = edf_misses = rm_sets = edf_sets = total_jobs = 0;
+        actual = 0.0;
+        for (set = 0; set < NUM_SETS; ++set)
+        {
+            /* Rounding short tasks up to one tick can overshoot, so throw those sets away */
+            do
+            {
+                u = make_task_set(tasks, target);
+            } while (u > target);
+            actual += u;
+            m = simulate(tasks, false, &jobs);
+            rm_misses += m;
+            rm_sets += (m > 0);
+            total_jobs += jobs;
+            m = simulate(tasks, true, &jobs);
+            edf_misses += m;
+            edf_sets += (m > 0);
+        }
+        printf("%.2f,%.3f,%d,%u,%u,%u,%u,%u\n", target, actual / NUM_SETS, NUM_SETS, total_jobs,
+               rm_sets, rm_misses, edf_sets, edf_misses);
+    }
+    return 0;
+}
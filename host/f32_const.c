@@ -0,0 +1,137 @@
+/*
+ * f32_const.c
+ *
+ * Host program printing f32_t (or fix32_t) initialisers for decimal constants, so that tables
+ * can be const, in flash, instead of being filled in by get_f32_from_float() at run time.
+ *
+ * Build and run on the host:
+ *     gcc -O2 -o f32_const host/f32_const.c -lm
+ *     ./f32_const 3.14159265358979 -2.5e-3          f32_t
+ *     ./f32_const -p 24 1.5 -0.001                  fix32_t with 24 bits after the point
+ *     ./f32_const -p auto 1.5 -0.001                fix32_t with as many as will fit
+ *
+ * Each value is read as a long double, and the mantissa rounded to nearest from that, so the
+ * answer is as close as 32 bits get - closer than get_f32_from_float(), which only has the 24
+ * bits of a float to start with. f32_t values are normalised, except below 2^-97, where they
+ * round to the nearest denormal (exponent -128). Beyond its range they saturate or are zero,
+ * with a warning, as the arithmetic does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define AUTO_PRECISION  -1
+
+static void print_f32(const char *text, long double value)
+{
+    long double fraction;
+    uint64_t mantissa;
+    int exponent, signum;
+
+    signum = signbit(value) ? -1 : 1;
+    fraction = frexpl(fabsl(value), &exponent);     /* 0.5 <= fraction < 1 */
+    mantissa = (uint64_t)llroundl(ldexpl(fraction, 32));
+    exponent -= 32;
+    if (mantissa == 0x100000000ull)
+    {
+        mantissa = 0x80000000ull;                   /* Rounded up to the next power of two */
+        ++exponent;
+    }
+
+    if (value == 0)
+    {
+        exponent = INT8_MIN;
+    }
+    else if (exponent > INT8_MAX)
+    {
+        fprintf(stderr, "%s is too big, saturating\n", text);
+        mantissa = UINT32_MAX;
+        exponent = INT8_MAX;
+    }
+    else if (exponent < INT8_MIN)
+    {
+        /* Below 2^-97 it can only be a denormal: exponent -128 and a smaller mantissa */
+        mantissa = (uint64_t)llroundl(ldexpl(fabsl(value), -INT8_MIN));
+        exponent = INT8_MIN;
+        if (mantissa == 0)
+        {
+            fprintf(stderr, "%s is too small, using zero\n", text);
+        }
+    }
+    printf("    {%10luUL, %4d, %+d},      /* %s */\n", (unsigned long)mantissa, exponent, signum,
+           text);
+}
+
+static void print_fix32(const char *text, long double value, int precision)
+{
+    long long mantissa;
+
+    if (precision == AUTO_PRECISION)
+    {
+        for (precision = 31; precision > 0; --precision)
+        {
+            mantissa = llroundl(ldexpl(value, precision));
+            if (mantissa >= INT32_MIN && mantissa <= INT32_MAX)
+            {
+                break;
+            }
+        }
+    }
+    mantissa = llroundl(ldexpl(value, precision));
+    if (mantissa < INT32_MIN || mantissa > INT32_MAX)
+    {
+        fprintf(stderr, "%s doesn't fit with precision %d\n", text, precision);
+        return;
+    }
+    printf("    {%11ldL, %2d},      /* %s */\n", (long)mantissa, precision, text);
+}
+
+int main(int argc, char *argv[])
+{
+    int i, precision = AUTO_PRECISION;
+    int first = 1, fixed = 0;
+    long double value;
+    char *end;
+
+    if (argc > 2 && strcmp(argv[1], "-p") == 0)
+    {
+        fixed = 1;
+        first = 3;
+        if (strcmp(argv[2], "auto") != 0)
+        {
+            precision = atoi(argv[2]);
+            if (precision < 0 || precision > 31)
+            {
+                fprintf(stderr, "Precision must be 0 to 31, or auto\n");
+                return 1;
+            }
+        }
+    }
+    if (first >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-p precision|auto] value...\n", argv[0]);
+        return 1;
+    }
+
+    for (i = first; i < argc; ++i)
+    {
+        value = strtold(argv[i], &end);
+        if (end == argv[i] || *end != 0)
+        {
+            fprintf(stderr, "Can't read %s as a number\n", argv[i]);
+            return 1;
+        }
+        if (fixed)
+        {
+            print_fix32(argv[i], value, precision);
+        }
+        else
+        {
+            print_f32(argv[i], value);
+        }
+    }
+    return 0;
+}
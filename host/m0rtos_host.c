@@ -0,0 +1,294 @@
+/*
+ * POSIX host port of M0RTOS, so the kernel can run (and be tested) on a Linux PC
+ *
+ * Everything in m0rtos.c that isn't ARM-specific is used as-is. This file replaces the rest:
+ *   - each task runs on its own ucontext, in the task's stack array
+ *   - SIGUSR1 stands in for the yield interrupt, its handler calls choose_next_task()
+ *   - SIGALRM (from setitimer) stands in for the tick interrupt
+ *   - the critical section and PRIMASK are both done by blocking signals
+ *
+ * Build with host/ first on the include path, so its stand-in CMSIS headers are used:
+ *   gcc -O2 -Ihost -I. -o m0rtos_host host/main_host.c host/m0rtos_host.c m0rtos.c float32.c fixed_point.c int_math.c power.c printf.c -lm
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/time.h>
+#include "stm32l031xx.h"
+#include "m0rtos.h"
+#include "m0rtos_host.h"
+
+#define YIELD_SIGNAL    SIGUSR1
+#define TICK_SIGNAL     SIGALRM
+
+extern uint32_t *choose_next_task(uint32_t *current_sp);
+extern __NO_RETURN void idle_task_function(void *arg);
+extern void task_returned(void);
+
+static sigset_t irq_signals;            /* Every signal that stands in for an interrupt       */
+static sigset_t realtime_signals;       /* The ones a critical section doesn't mask           */
+static sigset_t disabled_signals;       /* Switched off, like a clear bit in NVIC->ISER       */
+static host_irq_handler_t *irq_handlers[NSIG];
+static bool started;
+static bool primask;
+static bool in_critical;
+static unsigned irq_depth;              /* Non-zero while in a signal handler                 */
+static unsigned tick_period_us;
+
+static ucontext_t idle_context;
+static ucontext_t *current_context;
+
+/*
+ * Set the signal mask to match the PRIMASK and critical section state
+ * Inside a handler the mask is already set, and will be restored on return
+ */
+static void update_signal_mask(void)
+{
+    sigset_t mask;
+    int sig;
+
+    if (irq_depth != 0)
+    {
+        return;
+    }
+    mask = disabled_signals;
+    if (primask)
+    {
+        mask = irq_signals;
+    }
+    else if (in_critical)
+    {
+        mask = irq_signals;
+        for (sig = 1; sig < NSIG; ++sig)
+        {
+            if (sigismember(&realtime_signals, sig) && !sigismember(&disabled_signals, sig))
+            {
+                sigdelset(&mask, sig);
+            }
+        }
+    }
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+}
+
+void _enter_critical(void)
+{
+    in_critical = true;
+    update_signal_mask();
+}
+
+void _exit_critical(void)
+{
+    in_critical = false;
+    update_signal_mask();
+}
+
+void host_disable_irq(void)
+{
+    primask = true;
+    update_signal_mask();
+}
+
+void host_enable_irq(void)
+{
+    primask = false;
+    update_signal_mask();
+}
+
+/*
+ * Wait for an interrupt. Like WFI, if interrupts are disabled this returns with the interrupt
+ * still pending, and it is taken once they are enabled.
+ */
+void host_wait_for_irq(void)
+{
+    sigset_t enabled;
+    int sig;
+
+    if (primask)
+    {
+        enabled = irq_signals;
+        for (sig = 1; sig < NSIG; ++sig)
+        {
+            if (sigismember(&disabled_signals, sig))
+            {
+                sigdelset(&enabled, sig);
+            }
+        }
+        if (sigwait(&enabled, &sig) == 0)
+        {
+            raise(sig);
+        }
+    }
+    else
+    {
+        sigsuspend(&disabled_signals);
+    }
+}
+
+/*
+ * The first thing every task runs. A new task is always started from inside the yield handler,
+ * so leave the handler state behind before calling the task function.
+ */
+static void task_trampoline(unsigned function_hi, unsigned function_lo)
+{
+    task_function_t *task_function;
+
+    task_function = (task_function_t *)(uintptr_t)(((uint64_t)function_hi << 32) | function_lo);
+    irq_depth = 0;
+    update_signal_mask();
+    task_function(NULL);
+    task_returned();
+}
+
+/*
+ * Put a ucontext at the bottom of the stack array, and use the rest as the task's stack
+ * The "stack pointer" the kernel keeps for the task is the address of its ucontext.
+ */
+uint32_t *create_task_stack(task_function_t *task_function, uint32_t *stack, unsigned stack_words)
+{
+    ucontext_t *context;
+    uint8_t *stack_start;
+    uint64_t function;
+
+    context     = (ucontext_t *)(((uintptr_t)stack + 15) & ~(uintptr_t)15);
+    stack_start = (uint8_t *)(context + 1);
+    function    = (uintptr_t)task_function;
+
+    getcontext(context);
+    context->uc_stack.ss_sp   = stack_start;
+    context->uc_stack.ss_size = (uint8_t *)(stack + stack_words) - stack_start;
+    context->uc_link          = NULL;
+    sigfillset(&context->uc_sigmask);
+    makecontext(context, (void (*)(void))task_trampoline, 2,
+                (unsigned)(function >> 32), (unsigned)function);
+    return (uint32_t *)context;
+}
+
+void yield(void)
+{
+    if (started)
+    {
+        raise(YIELD_SIGNAL);
+    }
+}
+
+static void yield_handler(int sig)
+{
+    ucontext_t *previous;
+
+    (void)sig;
+    ++irq_depth;
+    previous        = current_context;
+    current_context = (ucontext_t *)choose_next_task((uint32_t *)previous);
+    if (current_context != previous)
+    {
+        swapcontext(previous, current_context);
+    }
+    --irq_depth;
+}
+
+static void irq_handler(int sig)
+{
+    ++irq_depth;
+    irq_handlers[sig]();
+    --irq_depth;
+}
+
+static void install_handler(int sig, void (*handler)(int))
+{
+    struct sigaction action;
+
+    action.sa_handler = handler;
+    action.sa_mask    = irq_signals;
+    action.sa_flags   = SA_RESTART;
+    sigaction(sig, &action, NULL);
+}
+
+/*
+ * Use a signal as an interrupt, calling handler when it is raised. Call before start_rtos().
+ * Realtime interrupts are not masked by critical sections, and so mustn't call M0RTOS functions.
+ */
+void host_add_irq(int sig, host_irq_handler_t *handler, bool realtime)
+{
+    sigaddset(&irq_signals, sig);
+    if (realtime)
+    {
+        sigaddset(&realtime_signals, sig);
+    }
+    irq_handlers[sig] = handler;
+}
+
+/*
+ * Set the tick period. Call before start_rtos(), zero means no tick.
+ */
+void host_init_tick(unsigned microseconds_per_tick)
+{
+    tick_period_us = microseconds_per_tick;
+    host_add_irq(TICK_SIGNAL, tick, false);
+}
+
+/*
+ * Switch the tick interrupt off or on, as NVIC->ICER and ISER do on the target. A tick that
+ * falls due while it's off is held pending until it's switched on again.
+ */
+void host_enable_tick(bool enable)
+{
+    if (enable)
+    {
+        sigdelset(&disabled_signals, TICK_SIGNAL);
+    }
+    else
+    {
+        sigaddset(&disabled_signals, TICK_SIGNAL);
+    }
+    update_signal_mask();
+}
+
+/*
+ * A free-running 32-bit count of nanoseconds, counting down like SysTick->VAL
+ */
+uint32_t host_read_cycles(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return 0u - (uint32_t)((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+}
+
+void init_interrupts(void)
+{
+    struct itimerval timer;
+    int sig;
+
+    sigaddset(&irq_signals, YIELD_SIGNAL);
+    for (sig = 1; sig < NSIG; ++sig)
+    {
+        if (irq_handlers[sig])
+        {
+            install_handler(sig, irq_handler);
+        }
+    }
+    install_handler(YIELD_SIGNAL, yield_handler);
+    update_signal_mask();
+    started = true;
+
+    if (tick_period_us)
+    {
+        timer.it_interval.tv_sec  = tick_period_us / 1000000;
+        timer.it_interval.tv_usec = tick_period_us % 1000000;
+        timer.it_value            = timer.it_interval;
+        setitimer(ITIMER_REAL, &timer, NULL);
+    }
+}
+
+/*
+ * The idle task just carries on using the process's own stack
+ */
+void start_idle_task(uint32_t *idle_sp)
+{
+    (void)idle_sp;
+    current_context = &idle_context;
+    idle_task_function(NULL);
+}
@@ -0,0 +1,17 @@
+/*
+ * Functions only provided by the POSIX host port (host/m0rtos_host.c)
+ */
+#ifndef _M0RTOS_HOST_H
+#define _M0RTOS_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (host_irq_handler_t)(void);
+
+extern void host_init_tick(unsigned microseconds_per_tick);
+extern void host_add_irq(int sig, host_irq_handler_t *handler, bool realtime);
+extern void host_enable_tick(bool enable);
+extern uint32_t host_read_cycles(void);
+
+#endif
@@ -0,0 +1,439 @@
+/*
+ * Deterministic virtual-time port of M0RTOS
+ *
+ * This is an alternative to host/m0rtos_host.c. Tasks still run on ucontexts, but nothing
+ * happens in real time: a task says how many cycles of work it does with sim_consume(), and
+ * interrupts (the tick and any simulated sources) are delivered at the virtual time they fall
+ * due, unless masked by a critical section. The kernel code - choose_next_task(), tick(), the
+ * queues - is the real m0rtos.c, and each thing it does is charged a configured cycle cost.
+ *
+ * The same workload always gives the same result, so this can answer questions like "does
+ * adding a 2kHz sensor task break the 10ms control loop?" before touching hardware.
+ * See host/vsim_main.c for an example.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "stm32l031xx.h"
+#include "m0rtos.h"
+#include "m0rtos_vsim.h"
+
+#define SIM_STACK_WORDS     16384
+
+extern uint32_t *choose_next_task(uint32_t *current_sp);
+extern __NO_RETURN void idle_task_function(void *arg);
+extern void task_returned(void);
+
+static sim_costs_t costs;
+static sim_task_t *sim_tasks;
+static unsigned num_sim_tasks;
+static sim_irq_t *sim_irqs;
+static unsigned num_sim_irqs;
+
+static uint64_t now;
+static uint64_t end_time;
+static uint64_t next_tick;
+static uint64_t kernel_busy;
+static uint64_t idle_busy;
+static uint32_t random_state = 1;
+
+static bool started;
+static bool primask;
+static bool in_critical;
+static bool yield_pending;
+static unsigned irq_depth;
+
+static ucontext_t idle_context;
+static ucontext_t *current_context;
+static sim_task_t *current_sim_task;
+
+static void service_interrupts(void);
+
+/*
+ * Pseudo-random numbers, the same every run
+ */
+static uint32_t sim_random(uint32_t range)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return range ? (random_state >> 8) % range : 0;
+}
+
+uint64_t sim_now(void)
+{
+    return now;
+}
+
+static bool masked(void)
+{
+    return primask || in_critical || irq_depth != 0;
+}
+
+/*
+ * The time of the next interrupt, which may already be in the past if interrupts were masked
+ */
+static uint64_t next_event_time(void)
+{
+    uint64_t next = next_tick;
+    unsigned i;
+
+    for (i = 0; i < num_sim_irqs; ++i)
+    {
+        if (sim_irqs[i].arrival < next)
+        {
+            next = sim_irqs[i].arrival;
+        }
+    }
+    return next;
+}
+
+/*
+ * Response times are printed in microseconds
+ */
+static double cycles_to_us(uint64_t cycles)
+{
+    return (double)cycles * 1e6 / costs.clock_hz;
+}
+
+static int compare_uint32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(void)
+{
+    unsigned i, misses = 0;
+    sim_task_t *t;
+    sim_irq_t *irq;
+
+    printf("%-12s %4s %7s %6s %9s %9s %9s %9s %6s\n", "task", "prio", "jobs", "misses",
+           "min_us", "p50_us", "p99_us", "max_us", "cpu%");
+    for (i = 0; i < num_sim_tasks; ++i)
+    {
+        t = &sim_tasks[i];
+        qsort(t->responses, t->jobs, sizeof(t->responses[0]), compare_uint32);
+        printf("%-12s %4u %7u %6u", t->name, t->priority, t->jobs, t->misses);
+        if (t->jobs)
+        {
+            printf(" %9.1f %9.1f %9.1f %9.1f", cycles_to_us(t->responses[0]),
+                   cycles_to_us(t->responses[t->jobs / 2]),
+                   cycles_to_us(t->responses[(t->jobs * 99ull) / 100]),
+                   cycles_to_us(t->responses[t->jobs - 1]));
+        }
+        else
+        {
+            printf(" %9s %9s %9s %9s", "-", "-", "-", "-");
+        }
+        printf(" %6.2f\n", 100.0 * t->busy / now);
+        misses += t->misses;
+    }
+    for (i = 0; i < num_sim_irqs; ++i)
+    {
+        irq = &sim_irqs[i];
+        printf("%-12s %4s %7u %6u %39s %6.2f\n", irq->name, "irq", irq->count, irq->dropped, "",
+               100.0 * irq->busy / now);
+    }
+    printf("%-12s %66.2f\n", "kernel", 100.0 * kernel_busy / now);
+    printf("%-12s %66.2f\n", "idle", 100.0 * idle_busy / now);
+    printf("%u deadline misses in %.3f s\n", misses, (double)now / costs.clock_hz);
+    fflush(stdout);
+    exit(misses ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void check_end(void)
+{
+    if (now >= end_time)
+    {
+        report();
+    }
+}
+
+/*
+ * Take the earliest interrupt, which must be due
+ */
+static void take_interrupt(void)
+{
+    sim_irq_t *irq = NULL;
+    uint64_t earliest = next_tick;
+    uint32_t arrival;
+    unsigned i;
+
+    for (i = 0; i < num_sim_irqs; ++i)
+    {
+        if (sim_irqs[i].arrival < earliest)
+        {
+            earliest = sim_irqs[i].arrival;
+            irq      = &sim_irqs[i];
+        }
+    }
+
+    ++irq_depth;
+    if (irq)
+    {
+        now       += costs.irq_entry + irq->cost;
+        irq->busy += costs.irq_entry + irq->cost;
+        ++irq->count;
+        arrival = (uint32_t)irq->arrival;
+        if (!write_queue_irq(irq->queue, (uint8_t *)&arrival, sizeof(arrival)))
+        {
+            ++irq->dropped;
+        }
+        irq->next_period += irq->period;
+        irq->arrival      = irq->next_period + sim_random(irq->jitter + 1);
+    }
+    else
+    {
+        now         += costs.irq_entry + costs.tick;
+        kernel_busy += costs.irq_entry + costs.tick;
+        next_tick   += costs.clock_hz / costs.ticks_per_second;
+        tick();
+    }
+    --irq_depth;
+}
+
+/*
+ * The yield interrupt
+ */
+static void switch_task(void)
+{
+    ucontext_t *previous;
+    unsigned i;
+
+    now         += costs.irq_entry + costs.context_switch;
+    kernel_busy += costs.irq_entry + costs.context_switch;
+
+    previous         = current_context;
+    current_context  = (ucontext_t *)choose_next_task((uint32_t *)previous);
+    current_sim_task = NULL;
+    for (i = 0; i < num_sim_tasks; ++i)
+    {
+        if (sim_tasks[i].task.sp == (uint32_t *)current_context)
+        {
+            current_sim_task = &sim_tasks[i];
+        }
+    }
+    if (current_context != previous)
+    {
+        swapcontext(previous, current_context);
+    }
+}
+
+/*
+ * Deliver any interrupts that are due, then a pending yield
+ */
+static void service_interrupts(void)
+{
+    while (started && !masked())
+    {
+        check_end();
+        if (next_event_time() <= now)
+        {
+            take_interrupt();
+        }
+        else if (yield_pending)
+        {
+            yield_pending = false;
+            switch_task();
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+/*
+ * Do some work in the running task, letting interrupts in as they fall due
+ */
+void sim_consume(uint32_t cycles)
+{
+    uint64_t next, step;
+
+    while (cycles)
+    {
+        next = next_event_time();
+        step = cycles;
+        if (!masked() && next < now + cycles)
+        {
+            step = next > now ? next - now : 0;
+        }
+        now    += step;
+        cycles -= (uint32_t)step;
+        if (current_sim_task)
+        {
+            current_sim_task->busy += step;
+        }
+        service_interrupts();
+    }
+}
+
+void _enter_critical(void)
+{
+    in_critical  = true;
+    now         += costs.kernel_call;
+    kernel_busy += costs.kernel_call;
+}
+
+void _exit_critical(void)
+{
+    in_critical = false;
+    service_interrupts();
+}
+
+void host_disable_irq(void)
+{
+    primask = true;
+}
+
+void host_enable_irq(void)
+{
+    primask = false;
+    service_interrupts();
+}
+
+/*
+ * Idle until the next interrupt
+ */
+void host_wait_for_irq(void)
+{
+    uint64_t next = next_event_time();
+
+    if (next > now)
+    {
+        idle_busy += next - now;
+        now        = next;
+    }
+    service_interrupts();
+}
+
+void yield(void)
+{
+    yield_pending = true;
+    service_interrupts();
+}
+
+static void task_trampoline(unsigned function_hi, unsigned function_lo)
+{
+    task_function_t *task_function;
+
+    task_function = (task_function_t *)(uintptr_t)(((uint64_t)function_hi << 32) | function_lo);
+    task_function(NULL);
+    task_returned();
+}
+
+/*
+ * Put a ucontext at the bottom of the stack array, and use the rest as the task's stack
+ */
+uint32_t *create_task_stack(task_function_t *task_function, uint32_t *stack, unsigned stack_words)
+{
+    ucontext_t *context;
+    uint8_t *stack_start;
+    uint64_t function;
+
+    context     = (ucontext_t *)(((uintptr_t)stack + 15) & ~(uintptr_t)15);
+    stack_start = (uint8_t *)(context + 1);
+    function    = (uintptr_t)task_function;
+
+    getcontext(context);
+    context->uc_stack.ss_sp   = stack_start;
+    context->uc_stack.ss_size = (uint8_t *)(stack + stack_words) - stack_start;
+    context->uc_link          = NULL;
+    makecontext(context, (void (*)(void))task_trampoline, 2,
+                (unsigned)(function >> 32), (unsigned)function);
+    return (uint32_t *)context;
+}
+
+void init_interrupts(void)
+{
+    unsigned i;
+
+    next_tick = costs.clock_hz / costs.ticks_per_second;
+    for (i = 0; i < num_sim_irqs; ++i)
+    {
+        sim_irqs[i].next_period = sim_irqs[i].period;
+        sim_irqs[i].arrival     = sim_irqs[i].period + sim_random(sim_irqs[i].jitter + 1);
+    }
+    started = true;
+}
+
+void start_idle_task(uint32_t *idle_sp)
+{
+    (void)idle_sp;
+    current_context = &idle_context;
+    idle_task_function(NULL);
+}
+
+static void record_response(sim_task_t *t, uint64_t response)
+{
+    if (t->jobs == t->responses_size)
+    {
+        t->responses_size = t->responses_size ? t->responses_size * 2 : 1024;
+        t->responses      = realloc(t->responses, t->responses_size * sizeof(t->responses[0]));
+    }
+    t->responses[t->jobs] = (uint32_t)response;
+    ++t->jobs;
+    if (response > t->deadline)
+    {
+        ++t->misses;
+    }
+}
+
+/*
+ * Every simulated task runs this, doing its jobs as described by its sim_task_t
+ */
+static void sim_task_main(void *arg)
+{
+    sim_task_t *t = current_sim_task;
+    uint32_t cycles_per_tick = costs.clock_hz / costs.ticks_per_second;
+    uint32_t arrival;
+    uint64_t release;
+
+    (void)arg;
+    if (t->period)
+    {
+        set_task_period(&t->task, t->period, (t->deadline + cycles_per_tick - 1) / cycles_per_tick);
+    }
+    while (1)
+    {
+        if (t->period)
+        {
+            release = (uint64_t)t->task.release * cycles_per_tick;
+        }
+        else
+        {
+            read_queue(t->queue, (uint8_t *)&arrival, sizeof(arrival), -1);
+            release = now - (uint32_t)((uint32_t)now - arrival);
+        }
+        sim_consume(t->exec_min + sim_random(t->exec_max - t->exec_min + 1));
+        record_response(t, now - release);
+        if (t->period)
+        {
+            wait_for_next_period();
+        }
+    }
+}
+
+void sim_run(const sim_costs_t *sim_costs, sim_task_t *tasks, unsigned num_tasks,
+             sim_irq_t *irqs, unsigned num_irqs, uint32_t run_ticks)
+{
+    unsigned i;
+
+    costs         = *sim_costs;
+    sim_tasks     = tasks;
+    num_sim_tasks = num_tasks;
+    sim_irqs      = irqs;
+    num_sim_irqs  = num_irqs;
+    end_time      = (uint64_t)run_ticks * (costs.clock_hz / costs.ticks_per_second);
+
+    for (i = 0; i < num_tasks; ++i)
+    {
+        tasks[i].stack = malloc(SIM_STACK_WORDS * sizeof(uint32_t));
+        add_task(sim_task_main, &tasks[i].task, tasks[i].stack, SIM_STACK_WORDS,
+                 tasks[i].priority);
+    }
+    start_rtos();
+}
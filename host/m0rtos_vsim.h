@@ -0,0 +1,68 @@
+/*
+ * Deterministic virtual-time simulator for M0RTOS, see host/m0rtos_vsim.c
+ */
+#ifndef _M0RTOS_VSIM_H
+#define _M0RTOS_VSIM_H
+
+#include <stdint.h>
+#include "m0rtos.h"
+
+/* Cycle costs of the things the kernel does, on the target */
+typedef struct
+{
+    uint32_t clock_hz;
+    uint32_t ticks_per_second;
+    uint32_t irq_entry;         /* Exception entry plus exit, for every interrupt         */
+    uint32_t tick;              /* Body of the tick interrupt handler                     */
+    uint32_t context_switch;    /* Yield interrupt handler, including choose_next_task()  */
+    uint32_t kernel_call;       /* Charged for each critical section a kernel call enters */
+} sim_costs_t;
+
+/* A source of interrupts, e.g. a sensor's data-ready line */
+typedef struct
+{
+    const char *name;
+    uint32_t    period;         /* Cycles between interrupts                                */
+    uint32_t    jitter;         /* Each interrupt arrives up to this many cycles late       */
+    uint32_t    cost;           /* Cycles spent in the handler                              */
+    queue_t    *queue;          /* Each interrupt writes its arrival time here, as 4 bytes  */
+
+    /* Filled in by the simulator */
+    uint64_t    next_period;
+    uint64_t    arrival;
+    unsigned    count;
+    unsigned    dropped;        /* Interrupts that found the queue full                     */
+    uint64_t    busy;
+} sim_irq_t;
+
+/*
+ * A task, released either every period ticks or by each arrival time read from queue.
+ * Each job does between exec_min and exec_max cycles of work, and should finish within
+ * deadline cycles of its release.
+ */
+typedef struct
+{
+    const char *name;
+    unsigned    priority;
+    uint32_t    period;         /* Ticks between releases, or 0 to read releases from queue */
+    queue_t    *queue;
+    uint32_t    exec_min;
+    uint32_t    exec_max;
+    uint32_t    deadline;
+
+    /* Filled in by the simulator */
+    task_t      task;
+    uint32_t   *stack;
+    unsigned    jobs;
+    unsigned    misses;
+    uint64_t    busy;
+    uint32_t   *responses;
+    unsigned    responses_size;
+} sim_task_t;
+
+extern __NO_RETURN void sim_run(const sim_costs_t *costs, sim_task_t *tasks, unsigned num_tasks,
+                                sim_irq_t *irqs, unsigned num_irqs, uint32_t run_ticks);
+extern void sim_consume(uint32_t cycles);
+extern uint64_t sim_now(void);
+
+#endif
@@ -0,0 +1,512 @@
+/*
+ * Demo and self-check of M0RTOS running on a POSIX host, see host/m0rtos_host.c
+ *
+ *   gcc -O2 -Ihost -I. -o m0rtos_host host/main_host.c host/m0rtos_host.c m0rtos.c float32.c fixed_point.c int_math.c power.c printf.c -lm
+ *   ./m0rtos_host
+ *
+ * Add -DUSE_QUEUE_STATS and -DUSE_SUPERVISOR to check the queue statistics and the supervisor
+ * too. To run the kernel benchmarks instead of the demo, add -DBENCHMARK and bench.c:
+ *   gcc -O2 -DBENCHMARK -Ihost -I. -o m0rtos_bench host/main_host.c host/m0rtos_host.c m0rtos.c bench.c float32.c fixed_point.c int_math.c power.c printf.c -lm
+ *
+ * The tasks pass data through a queue, a message buffer, an event group and jobs for a couple of
+ * seconds. Meanwhile a crowd of stress tasks block on one queue and time out at the same tick,
+ * while a writer wakes some of them. Then the checker task prints what it saw, makes sure the
+ * supervisor (if built in) notices a task that stops checking in, and exits with a non-zero
+ * status on error.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32l031xx.h"
+#include "m0rtos.h"
+#include "m0rtos_host.h"
+#include "float32.h"
+#include "power.h"
+#include "bench.h"
+#include "util.h"
+
+#define TICKS_PER_SECOND            1000
+#define RUN_TICKS                   2000
+
+#define PRODUCER_DONE               0x01u
+#define CONSUMER_DONE               0x02u
+#define STRESS_DONE                 0x04u
+
+#define PRODUCER_TIMEOUT            20
+#define CONSUMER_TIMEOUT            200     /* It waits up to 100 ticks for data */
+#define CHECKER_TIMEOUT             5
+
+/* Host stacks hold a ucontext_t as well, and the C library wants plenty of room */
+#define HOST_STACK_WORDS            16384
+
+extern int putchar(int c);
+
+void producer_main(void *arg);
+void consumer_main(void *arg);
+void checker_main(void *arg);
+void stress_reader_main(void *arg);
+void stress_writer_main(void *arg);
+
+/*
+ * The stress readers all wait on stress_q from the start of each round. Half of them time out
+ * together STRESS_TIMEOUT ticks later, from the middle of the wait list, and the rest a tick
+ * after. In even rounds the writer writes a few bytes in between, which wakes them all, and the
+ * ones that don't get a byte block again.
+ */
+#define STRESS_READERS              16
+#define STRESS_ROUNDS               50
+#define STRESS_START                10
+#define STRESS_ROUND_TICKS          4
+#define STRESS_TIMEOUT              2
+#define STRESS_WRITES               3
+
+#define HOST_TASKS(TASK)                                \
+    TASK(checker_task,  checker_main,  HOST_STACK_WORDS, 0) \
+    TASK(producer_task, producer_main, HOST_STACK_WORDS, 1) \
+    TASK(consumer_task, consumer_main, HOST_STACK_WORDS, 1) \
+    TASK(stress_writer_task, stress_writer_main, HOST_STACK_WORDS, 1) \
+    TASK(stress0_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress1_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress2_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress3_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress4_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress5_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress6_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress7_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress8_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress9_task,  stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress10_task, stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress11_task, stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress12_task, stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress13_task, stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress14_task, stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(stress15_task, stress_reader_main, HOST_STACK_WORDS, 1) \
+    TASK(job_task,      job_runner,    HOST_STACK_WORDS, 2)
+
+DECLARE_TASK_TABLE(host_tasks, HOST_TASKS);
+
+DECLARE_QUEUE(byte_q, 17);
+DECLARE_MESSAGE_BUFFER(message_b, 64);
+DECLARE_QUEUE_SET(consumer_set);
+DECLARE_QUEUE(empty_q, 2);
+DECLARE_QUEUE(stress_q, STRESS_WRITES * STRESS_ROUNDS + 1);
+DECLARE_EVENT_GROUP(done_events);
+
+static const queue_select_t consumer_selects[] =
+{
+    {&message_b, 1, false},
+    {&byte_q,    1, false},
+};
+
+static volatile unsigned bytes_sent, bytes_received, byte_errors;
+static volatile unsigned messages_sent, messages_received, message_errors;
+static volatile unsigned jobs_activated, jobs_run;
+#ifdef USE_SUPERVISOR
+static volatile unsigned watchdog_kicks;
+#endif
+static volatile unsigned stress_written, stress_read, stress_timeouts, stress_finished;
+static unsigned stress_readers_started;
+
+static void count_job(void *arg)
+{
+    (void)arg;
+    ++jobs_run;
+}
+
+DECLARE_JOB(counter_job, count_job, NULL, 0);
+
+static volatile unsigned done_jobs_run;
+
+static void done_job_function(void *arg)
+{
+    (void)arg;
+    ++done_jobs_run;
+}
+
+DECLARE_JOB(done_job, done_job_function, NULL, 1);
+
+/*
+ * Each job notes its letter as it runs. The low job activates the middle one, which should
+ * run nested inside it, so the low job notes a second, lower case letter when it gets back.
+ */
+static char job_order[8];
+static unsigned job_order_length;
+
+static void note_job(void *arg)
+{
+    if (job_order_length < sizeof(job_order) - 1)
+    {
+        job_order[job_order_length++] = *(const char *)arg;
+    }
+}
+
+DECLARE_JOB(high_job, note_job, "H", 0);
+DECLARE_JOB(middle_job, note_job, "M", 1);
+
+static void low_job_function(void *arg)
+{
+    note_job(arg);
+    activate_job(&middle_job);
+    note_job("l");
+}
+
+DECLARE_JOB(low_job, low_job_function, "L", 2);
+
+void producer_main(void *arg)
+{
+    uint8_t message[10];
+    uint8_t value = 0;
+    unsigned length;
+
+#ifdef USE_SUPERVISOR
+    supervise_task(&producer_task, PRODUCER_TIMEOUT);
+#endif
+    while ((int32_t)(ticks - RUN_TICKS) < 0)
+    {
+#ifdef USE_SUPERVISOR
+        supervisor_check_in();
+#endif
+        write_queue(&byte_q, &value, 1, -1);
+        ++value;
+        ++bytes_sent;
+
+        if ((value & 7) == 0)
+        {
+            length = 1 + value % sizeof(message);
+            message[0] = (uint8_t)length;
+            write_message(&message_b, message, length, -1);
+            ++messages_sent;
+            activate_job(&counter_job);
+            ++jobs_activated;
+            sleep(1);
+        }
+    }
+#ifdef USE_SUPERVISOR
+    supervise_task(&producer_task, 0);
+#endif
+    set_event_bits(&done_events, PRODUCER_DONE);
+    while (1)
+    {
+        sleep(1000);
+    }
+}
+
+void consumer_main(void *arg)
+{
+    uint8_t message[10];
+    uint8_t expected = 0;
+    uint8_t value;
+    int ready;
+
+#ifdef USE_SUPERVISOR
+    supervise_task(&consumer_task, CONSUMER_TIMEOUT);
+#endif
+    while (1)
+    {
+#ifdef USE_SUPERVISOR
+        supervisor_check_in();
+#endif
+        ready = select_queue(&consumer_set, consumer_selects, 2, 100);
+        if (ready == 0)
+        {
+            if (read_message(&message_b, message, sizeof(message), 0) != message[0])
+            {
+                ++message_errors;
+            }
+            ++messages_received;
+        }
+        else if (ready == 1)
+        {
+            read_queue(&byte_q, &value, 1, 0);
+            if (value != expected)
+            {
+                ++byte_errors;
+            }
+            expected = value + 1;
+            ++bytes_received;
+        }
+        else
+        {
+            /* Nothing for 100 ticks, the producer must have finished */
+            set_event_bits(&done_events, CONSUMER_DONE);
+        }
+    }
+}
+
+void stress_reader_main(void *arg)
+{
+    unsigned round, timeout;
+    uint8_t b;
+    bool got;
+
+    enter_critical();
+    timeout = STRESS_TIMEOUT + (stress_readers_started++ & 1);
+    exit_critical();
+
+    for (round = 0; round < STRESS_ROUNDS; ++round)
+    {
+        sleep_until(STRESS_START + round * STRESS_ROUND_TICKS);
+        got = read_queue(&stress_q, &b, 1, timeout);
+        enter_critical();
+        if (got)
+        {
+            ++stress_read;
+        }
+        else
+        {
+            ++stress_timeouts;
+        }
+        exit_critical();
+    }
+
+    enter_critical();
+    if (++stress_finished == STRESS_READERS + 1)
+    {
+        set_event_bits(&done_events, STRESS_DONE);
+    }
+    exit_critical();
+    while (1)
+    {
+        sleep(1000);
+    }
+}
+
+void stress_writer_main(void *arg)
+{
+    unsigned round, i;
+
+    for (round = 0; round < STRESS_ROUNDS; round += 2)
+    {
+        /* Write while the readers are all blocked, half way to their timeout */
+        sleep_until(STRESS_START + round * STRESS_ROUND_TICKS + STRESS_TIMEOUT / 2);
+        for (i = 0; i < STRESS_WRITES; ++i)
+        {
+            write_queue(&stress_q, (const uint8_t *)"", 1, 0);
+            ++stress_written;
+        }
+    }
+
+    enter_critical();
+    if (++stress_finished == STRESS_READERS + 1)
+    {
+        set_event_bits(&done_events, STRESS_DONE);
+    }
+    exit_critical();
+    while (1)
+    {
+        sleep(1000);
+    }
+}
+
+/*
+ * Every read either got a byte or timed out, no byte was lost, and nobody is left on the queue
+ */
+static unsigned check_stress(void)
+{
+    uint8_t b;
+    unsigned left = 0;
+
+    while (read_queue(&stress_q, &b, 1, 0))
+    {
+        ++left;
+    }
+    dprintf("stress: %u reads, %u timeouts, %u/%u bytes\n", stress_read, stress_timeouts,
+            stress_read + left, stress_written);
+    if (stress_read + stress_timeouts != STRESS_READERS * STRESS_ROUNDS ||
+        stress_read + left != stress_written || stress_q.blocked_list != NULL)
+    {
+        dprintf("Wait list error\n");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Jobs run highest priority first, and a job activated from inside a lower priority one runs
+ * before that returns. The checker outranks the job runner, so both jobs are pending before
+ * either runs.
+ */
+static unsigned check_job_order(void)
+{
+    activate_job(&low_job);
+    activate_job(&high_job);
+    sleep(2);
+    dprintf("jobs ran in the order %s\n", job_order);
+    if (strcmp(job_order, "HLMl") != 0)
+    {
+        dprintf("Job order error\n");
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef USE_QUEUE_STATS
+/*
+ * Print every registered queue's statistics, and check they agree with what the tasks counted
+ */
+static unsigned check_queue_stats(void)
+{
+    queue_stats_t stats;
+    queue_t *q;
+    uint8_t b;
+    unsigned failures = 0;
+
+    /* Nothing writes to empty_q, so this blocks and times out */
+    read_queue(&empty_q, &b, 1, 3);
+    get_queue_stats(&empty_q, &stats, false);
+    if (stats.reader_blocks == 0 || stats.timeouts != 1 || stats.blocked_ticks < 3)
+    {
+        ++failures;
+    }
+
+    for (q = next_registered_queue(NULL); q; q = next_registered_queue(q))
+    {
+        get_queue_stats(q, &stats, false);
+        dprintf("%s: read %u bytes %u messages, written %u bytes %u messages, peak %d, "
+                "blocked %u readers %u writers for %u ticks, %u timeouts\n", stats.name,
+                stats.bytes_read, stats.messages_read, stats.bytes_written,
+                stats.messages_written, stats.peak_level, stats.reader_blocks,
+                stats.writer_blocks, stats.blocked_ticks, stats.timeouts);
+        if (stats.bytes_read != stats.bytes_written || stats.peak_level >= (int)q->max)
+        {
+            ++failures;
+        }
+    }
+    get_queue_stats(&byte_q, &stats, false);
+    if (stats.bytes_written != bytes_sent)
+    {
+        ++failures;
+    }
+    get_queue_stats(&message_b, &stats, false);
+    if (stats.messages_read != messages_received || stats.messages_written != messages_sent)
+    {
+        ++failures;
+    }
+    if (failures)
+    {
+        dprintf("Queue statistics error\n");
+    }
+    return failures;
+}
+#endif
+
+#ifdef USE_SUPERVISOR
+/*
+ * Check the supervisor kept kicking, then stop checking in and make sure it notices
+ */
+static unsigned check_supervisor(void)
+{
+    unsigned failures = 0;
+    unsigned kicks;
+
+    if (supervisor_failed_task != NULL || watchdog_kicks == 0)
+    {
+        dprintf("Supervisor error, %u kicks\n", watchdog_kicks);
+        ++failures;
+    }
+
+    supervise_task(&checker_task, CHECKER_TIMEOUT);
+    sleep(CHECKER_TIMEOUT + 2);
+    kicks = watchdog_kicks;
+    sleep(2);
+    if (supervisor_failed_task != &checker_task || watchdog_kicks != kicks)
+    {
+        dprintf("Supervisor missed a task\n");
+        ++failures;
+    }
+    return failures;
+}
+
+void supervisor_kick_hook(void)
+{
+    ++watchdog_kicks;
+}
+#endif
+
+void checker_main(void *arg)
+{
+    uint32_t flags;
+    unsigned failures = 0;
+
+    f32_test();
+    power_test();
+
+    flags = wait_event_bits(&done_events, PRODUCER_DONE | CONSUMER_DONE | STRESS_DONE, EVENT_WAIT_ALL,
+                            RUN_TICKS + 1000);
+
+    dprintf("\nbytes %u/%u, messages %u/%u, jobs %u/%u, %u ticks\n", bytes_received, bytes_sent,
+            messages_received, messages_sent, jobs_run, jobs_activated, ticks);
+    if (flags == 0)
+    {
+        dprintf("Timed out waiting for producer and consumer\n");
+        ++failures;
+    }
+    if (wait_event_bits(&done_events, 0, 0, -1) != 0 ||
+        wait_event_bits(&done_events, 0, EVENT_WAIT_ALL, -1) != 0)
+    {
+        dprintf("Waiting for no event bits didn't return zero\n");
+        ++failures;
+    }
+    if (bytes_received != bytes_sent || byte_errors != 0)
+    {
+        dprintf("Queue error\n");
+        ++failures;
+    }
+    if (messages_received != messages_sent || message_errors != 0)
+    {
+        dprintf("Message buffer error\n");
+        ++failures;
+    }
+    if (jobs_run == 0 || jobs_run > jobs_activated)
+    {
+        dprintf("Job error\n");
+        ++failures;
+    }
+    failures += check_stress();
+    failures += check_job_order();
+#ifdef USE_QUEUE_STATS
+    failures += check_queue_stats();
+#endif
+#ifdef USE_SUPERVISOR
+    failures += check_supervisor();
+#endif
+
+    /* The producer set PRODUCER_DONE once, give the job time to run */
+    sleep(2);
+    if (done_jobs_run != 1)
+    {
+        dprintf("Event job ran %u times\n", done_jobs_run);
+        ++failures;
+    }
+    dprintf("%s\n", failures ? "FAIL" : "PASS");
+    exit(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+
+int outbyte(int c)
+{
+    /* Tasks share the C library's stdout buffer, so don't switch tasks in the middle */
+    enter_critical();
+    putchar(c);
+    exit_critical();
+    return 0;
+}
+
+int main(void)
+{
+#ifdef BENCHMARK
+    /* Run the kernel benchmarks (bench.c) instead of the demo */
+    bench_add_tasks();
+#else
+    add_task_table(host_tasks, sizeof(host_tasks) / sizeof(host_tasks[0]));
+    attach_event_job(&done_events, PRODUCER_DONE, &done_job);
+#ifdef USE_QUEUE_STATS
+    register_queue(&byte_q, "byte_q");
+    register_queue(&message_b, "message_b");
+    register_queue(&empty_q, "empty_q");
+#endif
+#endif
+    host_init_tick(1000000 / TICKS_PER_SECOND);
+    start_rtos();
+}
@@ -0,0 +1,15 @@
+/*
+ * Stand-in for the STM32L031 device header when building m0rtos for a POSIX host.
+ * Only the definitions the kernel itself uses are provided - there is no NVIC.
+ */
+#ifndef _HOST_STM32L031XX_H
+#define _HOST_STM32L031XX_H
+
+#include <cmsis_armcc.h>
+
+typedef enum
+{
+    LPTIM1_IRQn = 13
+} IRQn_Type;
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Example workload for the virtual-time simulator: does a 2kHz sensor task break the 10ms
+ * control loop?
+ *
+ *   gcc -O2 -Ihost -I. -o vsim host/vsim_main.c host/m0rtos_vsim.c m0rtos.c
+ *   ./vsim [sensor_us [seconds]]
+ *
+ * sensor_us is the sensor task's work per sample in microseconds (default 150, 0 for no sensor
+ * task at all). Add -DEDF_TASK_PRIO=1 to the build to run the same workload with EDF.
+ * The exit status is non-zero if any deadline was missed.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include "stm32l031xx.h"
+#include "m0rtos.h"
+#include "m0rtos_vsim.h"
+
+#define CLOCK_HZ                32000000u
+#define TICKS_PER_SECOND        1000u
+#define US(us)                  ((uint32_t)((us) * (CLOCK_HZ / 1000000u)))
+
+/*
+ * Estimated costs on an STM32L031 at 32MHz with one flash wait state
+ * Replace these with measured numbers when you have them.
+ */
+static const sim_costs_t costs =
+{
+    CLOCK_HZ,
+    TICKS_PER_SECOND,
+    32,         /* irq_entry      */
+    150,        /* tick           */
+    250,        /* context_switch */
+    60,         /* kernel_call    */
+};
+
+DECLARE_QUEUE(sensor_q, 8 * 4 + 1);
+DECLARE_QUEUE(uart_q, 16 * 4 + 1);
+
+static sim_irq_t irqs[] =
+{
+    /* name       period      jitter   cost     queue     */
+    {"sensor_irq", US(500),   US(20),  US(3),   &sensor_q},
+    {"uart_irq",   US(870),   US(200), US(2),   &uart_q},
+};
+
+static sim_task_t tasks[] =
+{
+    /* name       prio  period  queue      exec_min  exec_max   deadline  */
+    {"sensor",    0,    0,      &sensor_q, US(150),  US(150),   US(500)},
+    {"control",   1,    10,     NULL,      US(2500), US(3500),  US(10000)},
+    {"uart",      2,    0,      &uart_q,   US(40),   US(60),    US(5000)},
+    {"logger",    2,    100,    NULL,      US(8000), US(20000), US(100000)},
+};
+
+int main(int argc, char **argv)
+{
+    unsigned num_tasks = sizeof(tasks) / sizeof(tasks[0]);
+    unsigned num_irqs  = sizeof(irqs) / sizeof(irqs[0]);
+    unsigned sensor_us = 150;
+    unsigned seconds   = 10;
+
+    if (argc > 1)
+    {
+        sensor_us = atoi(argv[1]);
+    }
+    if (argc > 2)
+    {
+        seconds = atoi(argv[2]);
+    }
+
+    if (sensor_us)
+    {
+        tasks[0].exec_min = US(sensor_us);
+        tasks[0].exec_max = US(sensor_us);
+        sim_run(&costs, tasks, num_tasks, irqs, num_irqs, seconds * TICKS_PER_SECOND);
+    }
+    else
+    {
+        /* No sensor task, and no sensor interrupt */
+        sim_run(&costs, tasks + 1, num_tasks - 1, irqs + 1, num_irqs - 1,
+                seconds * TICKS_PER_SECOND);
+    }
+}
@@ -0,0 +1,948 @@
+/*
+ * int_math.c
+ *
+ *  Integer helpers shared by the float32 and fixed_point libraries
+ */
+
+#include <stdint.h>
+#include "int_math.h"
+
+/*
+ * Set to 1 to take square roots with the original bit at a time method, for comparison. Its
+ * remainder can overflow, so it is sometimes 1 too small.
+ */
+#ifndef BITWISE_SQUARE_ROOT
+#define BITWISE_SQUARE_ROOT     0
+#endif
+
+/* Leading zero count for each de Bruijn index, see count_leading_zeros() */
+const uint8_t clz_table[32] =
+{
+    31, 22, 30, 21, 18, 10, 29,  2, 20, 17, 15, 13,  9,  6, 28,  1,
+    23, 19, 11,  3, 16, 14,  7, 24, 12,  4,  8, 25,  5, 26, 27,  0,
+};
+
+/*
+ * Seeds for reciprocal_fraction(): 2^47 / d for d in the middle of each of 256 equal steps
+ * from 2^31 to 2^32, i.e. 1/d with 15 fraction bits
+ */
+static const uint16_t reciprocal_seed[256] =
+{
+    0xff80, 0xfe82, 0xfd86, 0xfc8c, 0xfb94, 0xfa9e, 0xf9a9, 0xf8b7,
+    0xf7c6, 0xf6d7, 0xf5ea, 0xf4ff, 0xf415, 0xf32d, 0xf247, 0xf163,
+    0xf080, 0xef9f, 0xeebf, 0xede1, 0xed05, 0xec2a, 0xeb51, 0xea7a,
+    0xe9a4, 0xe8cf, 0xe7fc, 0xe72b, 0xe65b, 0xe58c, 0xe4bf, 0xe3f4,
+    0xe329, 0xe260, 0xe199, 0xe0d3, 0xe00e, 0xdf4b, 0xde88, 0xddc8,
+    0xdd08, 0xdc4a, 0xdb8d, 0xdad1, 0xda17, 0xd95e, 0xd8a6, 0xd7ef,
+    0xd73a, 0xd685, 0xd5d2, 0xd520, 0xd46f, 0xd3bf, 0xd311, 0xd263,
+    0xd1b7, 0xd10c, 0xd062, 0xcfb9, 0xcf11, 0xce6a, 0xcdc4, 0xcd1f,
+    0xcc7b, 0xcbd8, 0xcb36, 0xca96, 0xc9f6, 0xc957, 0xc8b9, 0xc81c,
+    0xc780, 0xc6e5, 0xc64b, 0xc5b2, 0xc51a, 0xc482, 0xc3ec, 0xc357,
+    0xc2c2, 0xc22e, 0xc19b, 0xc109, 0xc078, 0xbfe8, 0xbf59, 0xbeca,
+    0xbe3c, 0xbdaf, 0xbd23, 0xbc98, 0xbc0d, 0xbb83, 0xbafb, 0xba72,
+    0xb9eb, 0xb964, 0xb8de, 0xb859, 0xb7d5, 0xb751, 0xb6ce, 0xb64c,
+    0xb5cb, 0xb54a, 0xb4ca, 0xb44b, 0xb3cc, 0xb34e, 0xb2d1, 0xb254,
+    0xb1d8, 0xb15d, 0xb0e3, 0xb069, 0xaff0, 0xaf77, 0xaeff, 0xae88,
+    0xae11, 0xad9b, 0xad26, 0xacb1, 0xac3d, 0xabc9, 0xab56, 0xaae4,
+    0xaa72, 0xaa01, 0xa990, 0xa920, 0xa8b1, 0xa842, 0xa7d3, 0xa766,
+    0xa6f8, 0xa68c, 0xa620, 0xa5b4, 0xa549, 0xa4df, 0xa475, 0xa40c,
+    0xa3a3, 0xa33a, 0xa2d3, 0xa26b, 0xa204, 0xa19e, 0xa138, 0xa0d3,
+    0xa06e, 0xa00a, 0x9fa6, 0x9f43, 0x9ee0, 0x9e7e, 0x9e1c, 0x9dba,
+    0x9d59, 0x9cf9, 0x9c99, 0x9c39, 0x9bda, 0x9b7c, 0x9b1d, 0x9ac0,
+    0x9a62, 0x9a05, 0x99a9, 0x994d, 0x98f1, 0x9896, 0x983b, 0x97e1,
+    0x9787, 0x972e, 0x96d5, 0x967c, 0x9624, 0x95cc, 0x9574, 0x951d,
+    0x94c7, 0x9470, 0x941b, 0x93c5, 0x9370, 0x931b, 0x92c7, 0x9273,
+    0x921f, 0x91cc, 0x9179, 0x9127, 0x90d5, 0x9083, 0x9032, 0x8fe1,
+    0x8f90, 0x8f40, 0x8ef0, 0x8ea0, 0x8e51, 0x8e02, 0x8db3, 0x8d65,
+    0x8d17, 0x8cc9, 0x8c7c, 0x8c2f, 0x8be2, 0x8b96, 0x8b4a, 0x8aff,
+    0x8ab3, 0x8a68, 0x8a1e, 0x89d3, 0x8989, 0x8940, 0x88f6, 0x88ad,
+    0x8864, 0x881c, 0x87d3, 0x878c, 0x8744, 0x86fd, 0x86b6, 0x866f,
+    0x8628, 0x85e2, 0x859c, 0x8557, 0x8511, 0x84cc, 0x8488, 0x8443,
+    0x83ff, 0x83bb, 0x8377, 0x8334, 0x82f1, 0x82ae, 0x826b, 0x8229,
+    0x81e7, 0x81a5, 0x8164, 0x8123, 0x80e2, 0x80a1, 0x8060, 0x8020
+};
+
+/*
+ * Estimate floor(2^63 / d) for 2^31 < d < 2^32, i.e. 1/d with 31 fraction bits if d is taken to
+ * have 32. The seed is good to 9 bits, then one Newton-Raphson step
+ *     x = x * (2 - d * x)
+ * in 32-bit arithmetic takes it to about 18 bits, and one with 64-bit products to 32 bits.
+ * The answer is never too big, and at most 3 too small.
+ */
+uint32_t reciprocal_fraction(uint32_t d)
+{
+    uint32_t x, product;
+    int32_t error;
+
+    x = reciprocal_seed[(d >> 23) & 0xff];
+
+    /* d * x, with 24 bits of d, should be 1.0 (2^31) - the error fits in 25 bits */
+    product = (d >> 16) * x + ((((d >> 8) & 0xff) * x) >> 8);
+    error   = (int32_t)(0x80000000u - product);
+    x       = (x << 16) + (uint32_t)((int32_t)(x * (error >> 9)) >> 6);
+
+    /* Same again with all of d, and x now 32 bits */
+    error = (int32_t)((int64_t)(0x8000000000000000ull - (uint64_t)d * x) >> 32);
+    x    += (uint32_t)(((int64_t)x * error) >> 31);
+
+    return x;
+}
+
+/*
+ * Points for reciprocal_square_root_fraction() to interpolate between: 2^15 / sqrt(f) for f
+ * from 1/4 to 1 in 96 equal steps (the first one, 2^16, is one too small to fit)
+ */
+static const uint16_t rsqrt_seed[97] =
+{
+    0xffff, 0xfc17, 0xf85b, 0xf4c8, 0xf15c, 0xee13, 0xeaec, 0xe7e4,
+    0xe4f9, 0xe22a, 0xdf75, 0xdcd7, 0xda51, 0xd7e1, 0xd585, 0xd33c,
+    0xd106, 0xcee1, 0xcccd, 0xcac8, 0xc8d3, 0xc6eb, 0xc512, 0xc345,
+    0xc185, 0xbfd0, 0xbe27, 0xbc89, 0xbaf5, 0xb96b, 0xb7ea, 0xb673,
+    0xb505, 0xb39f, 0xb241, 0xb0ec, 0xaf9d, 0xae56, 0xad16, 0xabdd,
+    0xaaab, 0xa97e, 0xa858, 0xa738, 0xa61d, 0xa508, 0xa3f9, 0xa2ee,
+    0xa1e9, 0xa0e8, 0x9fec, 0x9ef5, 0x9e02, 0x9d13, 0x9c29, 0x9b42,
+    0x9a60, 0x9981, 0x98a6, 0x97cf, 0x96fb, 0x962b, 0x955e, 0x9494,
+    0x93cd, 0x930a, 0x9249, 0x918c, 0x90d1, 0x9019, 0x8f64, 0x8eb1,
+    0x8e01, 0x8d53, 0x8ca8, 0x8c00, 0x8b59, 0x8ab5, 0x8a13, 0x8974,
+    0x88d6, 0x883b, 0x87a2, 0x870b, 0x8675, 0x85e2, 0x8550, 0x84c1,
+    0x8433, 0x83a7, 0x831c, 0x8293, 0x820c, 0x8187, 0x8103, 0x8081,
+    0x8000
+};
+
+/*
+ * About 2^47 / sqrt(x) for 2^30 <= x < 2^32, i.e. 1 / sqrt(x) if x is a fraction with 32 bits
+ * after the binary point and the answer has 31. The interpolated seed is good to 13 bits, a
+ * Newton-Raphson step
+ *     y = y * (3 - x * y * y) / 2
+ * in 32-bit arithmetic takes it to about 21, and one with 64-bit products to within 1.
+ * x = 2^30 would give 2^32, so the answer saturates at UINT32_MAX.
+ */
+uint32_t reciprocal_square_root_fraction(uint32_t x)
+{
+    uint32_t y, y2_32, product, index;
+    int32_t error;
+    int64_t big_error;
+    uint64_t y2;
+
+    /* Interpolate, with 16 bits of x below the table index */
+    index = (x >> 25) - 32;
+    y     = rsqrt_seed[index] -
+            (((rsqrt_seed[index] - rsqrt_seed[index + 1]) * ((x >> 9) & 0xffff)) >> 16);
+
+    /* x * y * y should be 1.0 (2^30), the top three 16 x 16 bit products are plenty */
+    y2_32   = y * y;
+    product = (y2_32 >> 16) * (x >> 16) + (((y2_32 >> 16) * (x & 0xffff)) >> 16) +
+              (((y2_32 & 0xffff) * (x >> 16)) >> 16);
+    error   = (int32_t)(0x40000000u - product);
+    y       = (y << 16) + (uint32_t)(((int32_t)y * (error >> 6)) >> 9);
+
+    /* Same again with 64-bit products, and y now 32 bits (1.0 is 2^62) */
+    big_error = (int64_t)(0x4000000000000000ull - (((uint64_t)y * y) >> 32) * x);
+    y2        = y + (((int64_t)y * (big_error >> 24)) >> 39);
+
+    return (y2 > UINT32_MAX) ? UINT32_MAX : (uint32_t)y2;
+}
+
+/*
+ * floor(sqrt(x * 2^32)), i.e. the square root of a 32-bit fraction as a 32-bit fraction
+ */
+#if BITWISE_SQUARE_ROOT
+/* Code adapted from the C Snippets Archive (public domain) */
+uint32_t square_root_fraction(uint32_t x)
+{
+    uint32_t acc = 0L;          /* accumulator   */
+    uint32_t rem = 0L;          /* remainder     */
+    uint32_t est = 0L;          /* trial product */
+    int i;
+
+    for (i = 0; i < 32; ++i)
+    {
+        rem = (rem << 2) + ((x & 0xc0000000u) >> 30);
+        x <<= 2;
+        acc <<= 1;
+        est = (acc << 1) + 1;
+        if (rem >= est)
+        {
+            rem -= est;
+            ++acc;
+        }
+    }
+    return acc;
+}
+#else
+uint32_t square_root_fraction(uint32_t x)
+{
+    uint32_t root;
+    int64_t remainder;
+    int shift;
+
+    if (x == 0)
+    {
+        return 0;
+    }
+
+    /* Shift up by an even number of bits, so that the top two aren't both zero */
+    shift = count_leading_zeros(x) & ~1;
+    x   <<= shift;
+
+    /* sqrt(x * 2^32) = x * 2^16 / sqrt(x) */
+    root      = ((uint64_t)x * reciprocal_square_root_fraction(x)) >> 31;
+    remainder = (int64_t)(((uint64_t)x << 32) - (uint64_t)root * root);
+
+    /* Now put right the last few bits */
+    while (remainder < 0)
+    {
+        --root;
+        remainder += 2 * (uint64_t)root + 1;
+    }
+    while (remainder > 2 * (int64_t)root)
+    {
+        remainder -= 2 * (uint64_t)root + 1;
+        ++root;
+    }
+
+    return root >> (shift / 2);
+}
+#endif /* BITWISE_SQUARE_ROOT */
+
+/*
+ * Trigonometry
+ *
+ * Both number formats unpack their arguments to unpacked_t and use these. An angle is reduced
+ * to within pi/4 of a multiple of pi/2, then the sine and cosine of what's left come from
+ * minimax polynomials in r^2, evaluated by Horner's rule in fixed point.
+ */
+
+/*
+ * 1 / (2 * pi) as a binary fraction, most significant bit first, with a word of zeroes in front
+ * so that angles from 2^-31 up can use it. Enough bits for any f32_t angle.
+ */
+static const uint32_t inverse_two_pi[8] =
+{
+    0x00000000, 0x28be60db, 0x9391054a, 0x7f09d5f4,
+    0x7d4d3770, 0x36d8a566, 0x4f10e410, 0x7f9458ea
+};
+
+#define TWO_PI_Q29          3373259426u                 /* 2 * pi * 2^29     */
+#define QUARTER_PI_Q32      3373259426u                 /* pi/4 * 2^32       */
+#define PI_Q61              7244019458077122842ll       /* pi * 2^61         */
+#define HALF_PI_Q61         3622009729038561421ll
+#define QUARTER_PI_Q61      1811004864519280710ll
+#define TAN_PI_8_Q31        889516852u                  /* tan(pi/8) * 2^31  */
+
+/*
+ * Minimax coefficients, fitted for 0 <= r <= pi/4 (tan(pi/8) for arctangent):
+ *     sin(r) / r    = 1 + z * (c[0] + z * (c[1] + ...))     z = r^2
+ *     cos(r)        = 1 + z * (c[0] + ...)
+ *     arctan(r) / r = 1 + z * (c[0] + ...)
+ * sine is 2^33 times, the others 2^32 times. The polynomials are good to 2^-37, 2^-34 and 2^-35.
+ * The 1 is added on separately, so that none of the 32 bits of the answer are wasted.
+ */
+#define SINE_Q      33
+#define COSINE_Q    32
+#define ARCTAN_Q    32
+
+static const int32_t sine_coefficients[4] =
+{
+    -1431655763, 71582754, -1704186, 23350
+};
+static const int32_t cosine_coefficients[4] =
+{
+    -2147483636, 178956785, -5964320, 104756
+};
+static const int32_t arctan_coefficients[6] =
+{
+    -1431655730, 858989387, -613409033, 474383119, -364144579, 203936481
+};
+
+/*
+ * z * (c[0] + z * (c[1] + ... c[n - 1])), with z and the answer 32-bit fractions (the answer
+ * signed, and less than 1/2 either way). The c[] have q bits after the point. Passing a q
+ * smaller than that gives a small answer more bits after the point.
+ */
+static int32_t polynomial(const int32_t *c, int n, int q, uint32_t z)
+{
+    int32_t p;
+    int i;
+
+    p = c[n - 1];
+    for (i = n - 2; i >= 0; --i)
+    {
+        p = c[i] + (int32_t)(((int64_t)p * z) >> 32);
+    }
+    return (int32_t)(((int64_t)p * z) >> q);
+}
+
+/*
+ * a = a * (1 + term), where term is signed, with point (32 or more) bits after the binary point
+ * The product is normalised before it's cut back to 32 bits, so the answer is good to 1 bit.
+ * It's worked out at half size, so that a positive term can't carry out of the top.
+ */
+static void add_term(unpacked_t *a, int32_t term, int point)
+{
+    uint64_t product;
+    int shift;
+
+    product  = ((uint64_t)a->mantissa << 31) +
+               (uint64_t)(((int64_t)a->mantissa * term) >> (point - 31));
+    shift    = count_leading_zeros_64(product);
+    a->mantissa = (uint32_t)((product << shift) >> 32);
+    a->exponent -= shift - 1;
+}
+
+/*
+ * r^2 as a 32-bit fraction, for |r| < 1
+ */
+static uint32_t square_fraction(const unpacked_t *r)
+{
+    int shift = -2 * r->exponent - 32;
+
+    if (r->mantissa == 0 || shift >= 64)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)r->mantissa * r->mantissa) >> shift);
+}
+
+/*
+ * Unpack a non-negative fixed point number, with point bits after the binary point
+ */
+static void unpack_fixed(unpacked_t *ret, uint64_t val, int point, bool negative)
+{
+    int shift;
+
+    ret->negative = negative;
+    if (val == 0)
+    {
+        ret->mantissa = 0;
+        ret->exponent = 0;
+        return;
+    }
+    shift         = count_leading_zeros_64(val);
+    ret->mantissa = (uint32_t)((val << shift) >> 32);
+    ret->exponent = 32 - point - shift;
+}
+
+/*
+ * The magnitude of a as a fixed point number, with point bits after the binary point
+ * a must be small enough to fit.
+ */
+static uint64_t get_fixed(const unpacked_t *a, int point)
+{
+    int shift = a->exponent + point;
+
+    if (shift >= 0)
+    {
+        return (uint64_t)a->mantissa << shift;
+    }
+    return (shift > -32) ? a->mantissa >> -shift : 0;
+}
+
+static void normalise_unpacked(unpacked_t *a)
+{
+    int shift;
+
+    if (a->mantissa != 0)
+    {
+        shift        = count_leading_zeros(a->mantissa);
+        a->mantissa <<= shift;
+        a->exponent  -= shift;
+    }
+}
+
+/*
+ * A value too big for either number format, or minus that
+ */
+static void saturate_unpacked(unpacked_t *ret, bool negative)
+{
+    ret->mantissa = UINT32_MAX;
+    ret->exponent = INT16_MAX;
+    ret->negative = negative;
+}
+
+/*
+ * a / b, for normalised a and b, with b not zero. The mantissa is exact, rounded down.
+ */
+static void divide_unpacked(unpacked_t *ret, const unpacked_t *a, const unpacked_t *b)
+{
+    uint64_t remainder;
+    int shift;
+
+    ret->negative = a->negative != b->negative;
+    ret->exponent = a->exponent - b->exponent - 31;
+    if (a->mantissa == 0 || b->mantissa == 0x80000000u)
+    {
+        ret->mantissa = a->mantissa;
+        return;
+    }
+
+    /* As divide_f32(): scale up one more bit if the answer is less than 1 */
+    shift = (b->mantissa > a->mantissa) ? 31 : 32;
+    ret->exponent -= 32 - shift;
+    ret->mantissa  = ((uint64_t)a->mantissa * reciprocal_fraction(b->mantissa)) >> shift;
+    remainder      = ((uint64_t)a->mantissa << (63 - shift)) - (uint64_t)ret->mantissa * b->mantissa;
+    while (remainder >= b->mantissa)
+    {
+        ++ret->mantissa;
+        remainder -= b->mantissa;
+    }
+}
+
+/*
+ * Find the quarter turn nearest to angle, and r = angle - quadrant * pi/2
+ * Returns the quadrant, 0 to 3.
+ *
+ * Angles up to pi/4 are left alone. Bigger ones are multiplied by 1 / (2 * pi) to get turns, as
+ * a 64-bit fraction. Only the bits of 1 / (2 * pi) that affect the fraction are needed: those
+ * above them give whole turns, and those below are too small to matter (Payne and Hanek).
+ */
+static unsigned reduce_angle(unpacked_t *r, const unpacked_t *angle)
+{
+    uint32_t high, middle, low, word[4];
+    uint64_t turns, product;
+    int64_t residual;
+    unsigned quadrant, first_bit, shift;
+    int i;
+
+    *r = *angle;
+    normalise_unpacked(r);
+    if (r->mantissa == 0 || r->exponent < -32 ||
+        (r->exponent == -32 && r->mantissa <= QUARTER_PI_Q32))
+    {
+        return 0;
+    }
+
+    /* The 96 bits of 1 / (2 * pi) from 2^-(exponent + 1) down */
+    first_bit = r->exponent + 32;
+    shift     = first_bit % 32;
+    for (i = 0; i < 4; ++i)
+    {
+        word[i] = inverse_two_pi[first_bit / 32 + i];
+    }
+    high   = shift ? (word[0] << shift) | (word[1] >> (32 - shift)) : word[0];
+    middle = shift ? (word[1] << shift) | (word[2] >> (32 - shift)) : word[1];
+    low    = shift ? (word[2] << shift) | (word[3] >> (32 - shift)) : word[2];
+
+    /* The fraction of a turn is the bottom 96 bits of mantissa * those, take the top 64 */
+    turns  = (uint64_t)(r->mantissa * high) << 32;
+    turns += (uint64_t)r->mantissa * middle;
+    turns += ((uint64_t)r->mantissa * low) >> 32;
+    if (r->negative)
+    {
+        turns = 0 - turns;
+    }
+
+    /* Nearest quarter turn, and what's left over (at most an eighth of a turn either way) */
+    quadrant = (unsigned)((turns + 0x2000000000000000ull) >> 62);
+    residual = (int64_t)(turns - ((uint64_t)quadrant << 62));
+    r->negative = residual < 0;
+    turns       = r->negative ? 0 - (uint64_t)residual : (uint64_t)residual;
+    if (turns == 0)
+    {
+        r->mantissa = 0;
+        return quadrant;
+    }
+
+    /* Turns to radians, with a 64 x 32 bit multiply */
+    shift       = count_leading_zeros_64(turns);
+    turns     <<= shift;
+    product     = (turns >> 32) * TWO_PI_Q29 + (((turns & 0xffffffffu) * TWO_PI_Q29) >> 32);
+    r->exponent = -29 - (int)shift;
+    if ((product >> 63) == 0)
+    {
+        product <<= 1;
+        --r->exponent;
+    }
+    r->mantissa = (uint32_t)(product >> 32);
+    return quadrant;
+}
+
+/*
+ * sin and cos of any angle. Either result pointer can be NULL.
+ */
+void sine_cosine_unpacked(unpacked_t *sine, unpacked_t *cosine, const unpacked_t *angle)
+{
+    unpacked_t r, s, c;
+    unsigned quadrant;
+    uint32_t z;
+
+    quadrant = reduce_angle(&r, angle);
+    z        = square_fraction(&r);
+
+    /* sin(r) = r * (sin(r) / r), which keeps the precision of small r */
+    s = r;
+    if (s.mantissa != 0)
+    {
+        add_term(&s, polynomial(sine_coefficients, 4, SINE_Q, z), 32);
+    }
+
+    /* cos(r) is between 1/sqrt(2) and 1, and only 1 needs 33 bits */
+    c.mantissa = 0u + (uint32_t)polynomial(cosine_coefficients, 4, COSINE_Q, z);
+    c.exponent = -32;
+    c.negative = false;
+    if (c.mantissa == 0)
+    {
+        c.mantissa = 0x80000000u;
+        c.exponent = -31;
+    }
+    normalise_unpacked(&c);
+
+    /* Turn the answers round to the right quadrant */
+    if (quadrant & 1)
+    {
+        unpacked_t swap = s;
+
+        s = c;
+        c = swap;
+        c.negative = !c.negative;
+    }
+    if (quadrant & 2)
+    {
+        s.negative = !s.negative;
+        c.negative = !c.negative;
+    }
+    if (sine)
+    {
+        *sine = s;
+    }
+    if (cosine)
+    {
+        *cosine = c;
+    }
+}
+
+/*
+ * sin / cos. Where the cosine is zero, the answer is too big for either number format.
+ */
+void tangent_unpacked(unpacked_t *ret, const unpacked_t *angle)
+{
+    unpacked_t s, c;
+
+    sine_cosine_unpacked(&s, &c, angle);
+    if (c.mantissa == 0)
+    {
+        saturate_unpacked(ret, s.negative != c.negative);
+        return;
+    }
+    divide_unpacked(ret, &s, &c);
+}
+
+/*
+ * The angle from the x axis to (x, y), from -pi to pi
+ */
+void arctangent2_unpacked(unpacked_t *ret, const unpacked_t *y, const unpacked_t *x)
+{
+    unpacked_t ax, ay, t;
+    uint32_t z, numerator, denominator, tq;
+    uint64_t angle;
+    bool swapped, small;
+
+    ax = *x;
+    ay = *y;
+    normalise_unpacked(&ax);
+    normalise_unpacked(&ay);
+
+    /* Work in the first octant, t = the smaller over the bigger */
+    swapped = ax.mantissa == 0 ||
+              (ay.mantissa != 0 && (ay.exponent > ax.exponent ||
+                                   (ay.exponent == ax.exponent && ay.mantissa > ax.mantissa)));
+    if (swapped)
+    {
+        t  = ax;
+        ax = ay;
+        ay = t;
+    }
+    if (ax.mantissa == 0)
+    {
+        /* Both zero */
+        ret->mantissa = 0;
+        ret->exponent = 0;
+        ret->negative = y->negative;
+        return;
+    }
+
+    divide_unpacked(&t, &ay, &ax);
+
+    /* arctan(t) = t * (arctan(t) / t), or pi/4 - arctan((1 - t) / (1 + t)) above tan(pi/8) */
+    tq = (t.mantissa == 0 || t.exponent <= -63) ? 0 :
+         (t.exponent >= -31) ? 0x80000000u : t.mantissa >> (-31 - t.exponent);
+    small = tq <= TAN_PI_8_Q31;
+    if (small)
+    {
+        z = square_fraction(&t);
+        if (t.mantissa != 0)
+        {
+            add_term(&t, polynomial(arctan_coefficients, 6, ARCTAN_Q, z), 32);
+        }
+        angle = get_fixed(&t, 61);
+    }
+    else if (tq == 0x80000000u)
+    {
+        angle = QUARTER_PI_Q61;
+    }
+    else
+    {
+        numerator   = 0x80000000u - tq;
+        denominator = 0x80000000u + tq;
+        tq = (uint32_t)(((uint64_t)numerator * reciprocal_fraction(denominator)) >> 31);
+        z  = (uint32_t)(((uint64_t)tq * tq) >> 32);
+        t.mantissa = tq;
+        t.exponent = -32;
+        add_term(&t, polynomial(arctan_coefficients, 6, ARCTAN_Q, z), 32);
+        angle = QUARTER_PI_Q61 - get_fixed(&t, 61);
+    }
+
+    /* Back out of the first octant */
+    if (swapped)
+    {
+        angle = HALF_PI_Q61 - angle;
+    }
+    if (x->negative && x->mantissa != 0)
+    {
+        angle = PI_Q61 - angle;
+    }
+    if (small && !swapped && !(x->negative && x->mantissa != 0))
+    {
+        /* Keep all the precision of a small answer */
+        *ret = t;
+        ret->negative = y->negative;
+        return;
+    }
+    unpack_fixed(ret, angle, 61, y->negative);
+}
+
+/*
+ * Exponentials and logarithms
+ *
+ * A number is split into 2^n * x, so that only x needs a polynomial: for logarithms x is within
+ * 1/sqrt(2) to sqrt(2), and for exponentials 2^x has x within 1/64 of one of 32 table points.
+ * The power that 2 is raised to is kept as a fixed point number with 55 bits after the point:
+ * anything 256 or more either way is out of range for both number formats anyway.
+ */
+#define Q55_ONE             0x0080000000000000ll
+#define Q55_LIMIT           256                         /* |a| < 256 fits in a Q55 int64_t */
+#define SQRT_2_Q31          3037000500u                 /* sqrt(2) * 2^31                  */
+#define LOG_Q               32
+#define EXP2_Q              31
+
+/*
+ * For each base b:
+ *   - log_b(2), with 55 bits after the point
+ *   - 2 / ln(b), as a mantissa and exponent, to turn artanh into log_b
+ *   - log2(b), with 55 bits after the point, to turn b^a into 2^(a * log2(b))
+ */
+static const struct
+{
+    int64_t  log_2;
+    uint32_t scale;
+    int      scale_exponent;
+    int64_t  log2_base;
+} log_bases[] =
+{
+    {36028797018963968ll, 3098164009u, -30,  36028797018963968ll},     /* LOG_BASE_2  */
+    {24973259072661437ll, 2147483648u, -30,  51978566788454385ll},     /* LOG_BASE_E  */
+    {10845748610397182ll, 3730561193u, -32, 119685073042290454ll},     /* LOG_BASE_10 */
+};
+
+/*
+ * Minimax coefficients:
+ *     artanh(u) / u = 1 + z * (c[0] + z * (c[1] + ...))     z = u^2, |u| <= 3 - 2 * sqrt(2)
+ *     2^g           = 1 + g * (c[0] + g * (c[1] + ...))            |g| <= 1/64
+ * The first with 32 bits after the point, good to 2^-37, the second with 31, good to 2^-43.
+ */
+static const int32_t log_coefficients[4] =
+{
+    1431655743, 859000657, 612834028, 506422966
+};
+static const int32_t exp2_coefficients[4] =
+{
+    1488522236, 515882495, 119195040, 20654902
+};
+
+/* 2^(j / 32) * 2^31, rounded */
+static const uint32_t exp2_table[32] =
+{
+    2147483648u, 2194507417u, 2242560872u, 2291666561u, 2341847524u, 2393127307u, 2445529972u,
+    2499080105u, 2553802834u, 2609723834u, 2666869345u, 2725266179u, 2784941738u, 2845924021u,
+    2908241642u, 2971923842u, 3037000500u, 3103502151u, 3171459999u, 3240905930u, 3311872529u,
+    3384393094u, 3458501653u, 3534232978u, 3611622603u, 3690706840u, 3771522796u, 3854108391u,
+    3938502376u, 4024744348u, 4112874773u, 4202935003u
+};
+
+/*
+ * a * b, where b and the answer have 55 bits after the point
+ * Returns false, leaving ret alone, if the answer is 256 or more either way.
+ */
+static bool multiply_q55(int64_t *ret, const unpacked_t *a, int64_t b)
+{
+    uint64_t magnitude, high, low, product;
+    int shift;
+
+    magnitude = b < 0 ? 0 - (uint64_t)b : (uint64_t)b;
+    if (a->mantissa == 0 || magnitude == 0)
+    {
+        *ret = 0;
+        return true;
+    }
+
+    /* The 96-bit product mantissa * magnitude is high * 2^32 + low */
+    high  = (uint64_t)a->mantissa * (magnitude >> 32);
+    low   = (uint64_t)a->mantissa * (magnitude & 0xffffffffu);
+    high += low >> 32;
+    low  &= 0xffffffffu;
+
+    shift = a->exponent + 32;
+    if (shift <= 0)
+    {
+        product = (shift > -64) ? high >> -shift : 0;
+    }
+    else
+    {
+        if (shift >= 63 || (high >> (63 - shift)) != 0)
+        {
+            return false;
+        }
+        product = (high << shift) | (shift < 32 ? low >> (32 - shift) : low << (shift - 32));
+        if (product >> 63)
+        {
+            return false;
+        }
+    }
+    *ret = (a->negative != (b < 0)) ? -(int64_t)product : (int64_t)product;
+    return true;
+}
+
+/*
+ * 2^a, with a having 55 bits after the point
+ */
+static void exp2_q55(unpacked_t *ret, int64_t a)
+{
+    uint64_t fraction, product;
+    int64_t g;
+    int32_t p, t;
+    unsigned j;
+    int k, i, shift;
+
+    /* a = k + j / 32 + g, with k whole and |g| <= 1/64. Offset a first, to round k down. */
+    k        = (int)(((uint64_t)a + 0x8000000000000000ull) >> 55) - Q55_LIMIT;
+    fraction = (uint64_t)a & (Q55_ONE - 1);
+    j        = (unsigned)((fraction + (Q55_ONE >> 6)) >> 50);
+    g        = (int64_t)fraction - ((int64_t)j << 50);
+    if (j == 32)
+    {
+        j = 0;
+        ++k;
+    }
+
+    /* 2^g - 1 = g * (c[0] + g * (...)), with g and t having 37 bits after the point */
+    g = g >> 18;
+    p = exp2_coefficients[3];
+    for (i = 2; i >= 0; --i)
+    {
+        p = exp2_coefficients[i] + (int32_t)(((int64_t)p * g) >> 37);
+    }
+    t = (int32_t)(((int64_t)p * g) >> EXP2_Q);
+
+    /* 2^(j / 32) * (1 + t), with 63 bits after the point, is between 2^-1/64 and 2 */
+    product  = (uint64_t)exp2_table[j] << 32;
+    product += (uint64_t)(((int64_t)exp2_table[j] * t) >> 5);
+    shift    = (int)(product >> 63) ^ 1;
+    ret->mantissa = (uint32_t)((product << shift) >> 32);
+    ret->exponent = k - 31 - shift;
+    ret->negative = false;
+}
+
+/*
+ * Split a into 2^n * x, with x between 1/sqrt(2) and sqrt(2), and work out f = log_b(x)
+ * Returns n. a must not be zero, and its sign is ignored.
+ */
+static int reduce_logarithm(unpacked_t *f, const unpacked_t *a, log_base_t base)
+{
+    unpacked_t numerator, denominator;
+    uint64_t sum;
+    uint32_t z;
+    int n, shift;
+
+    *f = *a;
+    normalise_unpacked(f);
+    n = f->exponent + 31;
+
+    /* f = log_b(x) = (2 / ln(b)) * artanh(u), where u = (x - 1) / (x + 1) */
+    numerator.exponent   = 0;
+    denominator.exponent = 1;
+    if (f->mantissa < SQRT_2_Q31)
+    {
+        /* x = mantissa / 2^31 */
+        numerator.mantissa = f->mantissa - 0x80000000u;
+        numerator.negative = false;
+        sum = (uint64_t)f->mantissa + 0x80000000u;
+    }
+    else
+    {
+        /* x = mantissa / 2^32 */
+        ++n;
+        numerator.mantissa = 0u - f->mantissa;
+        numerator.negative = true;
+        sum = (uint64_t)f->mantissa + 0x100000000ull;
+    }
+    if (numerator.mantissa == 0)
+    {
+        f->mantissa = 0;
+        f->exponent = 0;
+        f->negative = false;
+        return n;
+    }
+
+    /* The sum has 33 bits, the bottom one doesn't matter */
+    denominator.mantissa = (uint32_t)(sum >> 1);
+    denominator.negative = false;
+    normalise_unpacked(&numerator);
+    divide_unpacked(f, &numerator, &denominator);
+
+    /* The term is under 1/100, so give it 5 more bits */
+    z = square_fraction(f);
+    add_term(f, polynomial(log_coefficients, 4, LOG_Q - 5, z), 37);
+
+    /* Times 2 / ln(b), keeping all the bits when that is a power of two */
+    sum          = (uint64_t)f->mantissa * log_bases[base].scale;
+    shift        = count_leading_zeros_64(sum);
+    sum        <<= shift;
+    f->mantissa  = (uint32_t)(sum >> 32);
+    f->exponent += log_bases[base].scale_exponent + 32 - shift;
+    if ((sum & 0x80000000u) && f->mantissa != UINT32_MAX)
+    {
+        ++f->mantissa;      /* Round to nearest */
+    }
+    return n;
+}
+
+/*
+ * log_b(a). The sign of a is ignored, and the log of zero is too big for either number format.
+ */
+void logarithm_unpacked(unpacked_t *ret, const unpacked_t *a, log_base_t base)
+{
+    unpacked_t f;
+    int64_t total;
+    int n;
+
+    if (a->mantissa == 0)
+    {
+        saturate_unpacked(ret, true);
+        return;
+    }
+    n = reduce_logarithm(&f, a, base);
+    if (n == 0)
+    {
+        /* Keep all the precision of a small answer */
+        *ret = f;
+        return;
+    }
+
+    /* |f| is at most half of log_b(2), so the sum can't lose much to cancellation */
+    total  = n * log_bases[base].log_2;
+    total += f.negative ? -(int64_t)get_fixed(&f, 55) : (int64_t)get_fixed(&f, 55);
+    unpack_fixed(ret, total < 0 ? 0 - (uint64_t)total : (uint64_t)total, 55, total < 0);
+}
+
+/*
+ * b^a, found as 2^(a * log2(b)). Saturates if too big, and is zero if too small.
+ */
+void exponential_unpacked(unpacked_t *ret, const unpacked_t *a, log_base_t base)
+{
+    int64_t power;
+
+    if (!multiply_q55(&power, a, log_bases[base].log2_base))
+    {
+        if (a->negative)
+        {
+            ret->mantissa = 0;
+            ret->exponent = 0;
+            ret->negative = false;
+        }
+        else
+        {
+            saturate_unpacked(ret, false);
+        }
+        return;
+    }
+    exp2_q55(ret, power);
+}
+
+/*
+ * Whether a is an odd whole number
+ */
+static bool is_odd_unpacked(const unpacked_t *a)
+{
+    unpacked_t n = *a;
+
+    normalise_unpacked(&n);
+    if (n.mantissa == 0 || n.exponent > 0 || n.exponent < -31)
+    {
+        return false;
+    }
+    if (n.exponent == 0)
+    {
+        return (n.mantissa & 1) != 0;
+    }
+    return (n.mantissa & ((1u << -n.exponent) - 1)) == 0 && ((n.mantissa >> -n.exponent) & 1) != 0;
+}
+
+/*
+ * x^y, found as 2^(y * log2(x))
+ * A negative x is only allowed for whole y, otherwise its sign is ignored.
+ */
+void power_unpacked(unpacked_t *ret, const unpacked_t *x, const unpacked_t *y)
+{
+    unpacked_t f;
+    int64_t log2_x, power;
+    bool negative;
+    int n;
+
+    negative = x->negative && is_odd_unpacked(y);
+    if (y->mantissa == 0)
+    {
+        /* Anything to the power 0 is 1, even 0 */
+        ret->mantissa = 0x80000000u;
+        ret->exponent = -31;
+        ret->negative = false;
+        return;
+    }
+    if (x->mantissa == 0)
+    {
+        if (y->negative)
+        {
+            saturate_unpacked(ret, negative);
+        }
+        else
+        {
+            *ret = *x;
+            ret->negative = negative;
+        }
+        return;
+    }
+
+    /*
+     * log2(x) with 55 bits after the point, so that a big y doesn't magnify its error much.
+     * The fraction comes from ln(x) * log2(e), as ln(x) is the most accurate.
+     */
+    n = reduce_logarithm(&f, x, LOG_BASE_E);
+    multiply_q55(&log2_x, &f, log_bases[LOG_BASE_E].log2_base);
+    log2_x += (int64_t)n * Q55_ONE;
+
+    if (!multiply_q55(&power, y, log2_x))
+    {
+        if (y->negative == (log2_x < 0))
+        {
+            saturate_unpacked(ret, negative);
+        }
+        else
+        {
+            ret->mantissa = 0;
+            ret->exponent = 0;
+            ret->negative = negative;
+        }
+        return;
+    }
+    exp2_q55(ret, power);
+    ret->negative = negative;
+}
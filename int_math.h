@@ -0,0 +1,92 @@
+/*
+ * int_math.h
+ *
+ *  Integer helpers shared by the float32 and fixed_point libraries
+ */
+
+#ifndef INT_MATH_H_
+#define INT_MATH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern const uint8_t clz_table[32];
+
+/*
+ * Count the zero bits above the most significant one bit, i.e. how far val can be shifted up
+ * without losing anything. val must not be zero.
+ *
+ * The M0 has no CLZ instruction, so smear the top bit down into all the bits below it, which
+ * leaves one of only 32 values, and a de Bruijn multiply turns that into a table index. It takes
+ * the same time whatever val is, with no branches.
+ */
+static __inline int count_leading_zeros(uint32_t val)
+{
+    val |= val >> 1;
+    val |= val >> 2;
+    val |= val >> 4;
+    val |= val >> 8;
+    val |= val >> 16;
+    return clz_table[(val * 0x07c4acddu) >> 27];
+}
+
+/*
+ * The same for a 64-bit val, which must not be zero
+ */
+static __inline int count_leading_zeros_64(uint64_t val)
+{
+    if (val >> 32)
+    {
+        return count_leading_zeros((uint32_t)(val >> 32));
+    }
+    return 32 + count_leading_zeros((uint32_t)val);
+}
+
+/*
+ * floor(2^63 / d), or up to 3 less, for 2^31 < d < 2^32
+ */
+extern uint32_t reciprocal_fraction(uint32_t d);
+
+/*
+ * floor(sqrt(x * 2^32)) - the square root of x as a fraction with 32 bits after the binary
+ * point, exact and rounded down
+ */
+extern uint32_t square_root_fraction(uint32_t x);
+
+/*
+ * 2^47 / sqrt(x), to within 1, for x from 2^30 up, saturating at UINT32_MAX
+ */
+extern uint32_t reciprocal_square_root_fraction(uint32_t x);
+
+/*
+ * A number unpacked into a magnitude and a power of two, so that the trig routines can work on
+ * either number format: value = (negative ? -1 : 1) * mantissa * 2^exponent
+ * Zero has a zero mantissa, anything else doesn't need to be normalised.
+ */
+typedef struct
+{
+    uint32_t mantissa;
+    int      exponent;
+    bool     negative;
+} unpacked_t;
+
+extern void sine_cosine_unpacked(unpacked_t *sine, unpacked_t *cosine, const unpacked_t *angle);
+extern void tangent_unpacked(unpacked_t *ret, const unpacked_t *angle);
+extern void arctangent2_unpacked(unpacked_t *ret, const unpacked_t *y, const unpacked_t *x);
+
+typedef enum
+{
+    LOG_BASE_2,
+    LOG_BASE_E,
+    LOG_BASE_10
+} log_base_t;
+
+/*
+ * Exponentials and logarithms to base 2, e or 10, and x^y. Answers that are too big for either
+ * number format have exponent INT16_MAX, so that they saturate when packed.
+ */
+extern void exponential_unpacked(unpacked_t *ret, const unpacked_t *a, log_base_t base);
+extern void logarithm_unpacked(unpacked_t *ret, const unpacked_t *a, log_base_t base);
+extern void power_unpacked(unpacked_t *ret, const unpacked_t *x, const unpacked_t *y);
+
+#endif /* INT_MATH_H_ */
@@ -7,27 +7,66 @@
 #define INITIAL_REGISTER_VALUE  0xdeadbeef
 
 /* Flags for the state of a task */
-#define TASK_RUNNABLE   0
-#define TASK_SLEEPING   1
-#define TASK_BLOCKED    2
+#define TASK_RUNNABLE       0
+#define TASK_SLEEPING       1
+#define TASK_BLOCKED        2
+#define TASK_WAIT_ALL       4       /* Blocked on an event group until all the bits are set  */
+#define TASK_CLEAR_ON_EXIT  8       /* Clear the bits we waited for when the wait is over    */
+
+/* Statistics code that is only compiled in with USE_QUEUE_STATS */
+#ifdef USE_QUEUE_STATS
+#define QUEUE_STATS(statement)  statement
+#else
+#define QUEUE_STATS(statement)
+#endif
+
+/* Job ceiling when the job runner is between jobs - lower than any job priority */
+#define NO_JOB_RUNNING      (~0u)
 
 volatile uint32_t ticks;
 
-static task_t *task_list                     = NULL;
 static task_t *runnable_list[NUM_TASK_PRIOS] = {NULL};
 static task_t *suspended_list                = NULL;
 static task_t *running_task                  = NULL;
 
+#ifdef USE_SUPERVISOR
+/* Supervised tasks, earliest check-in deadline first, so tick() need only look at the head */
+static task_t *supervised_list               = NULL;
+task_t * volatile supervisor_failed_task     = NULL;
+#endif
+
+#ifdef USE_QUEUE_STATS
+/* Queues added by register_queue(), most recent first */
+static queue_t *registered_queues            = NULL;
+#endif
+
+/* Run-to-completion jobs, all run by one task on its stack */
+static job_t *pending_jobs                   = NULL;
+static task_t *job_runner_task               = NULL;
+static task_t *job_runner_blocked            = NULL;
+static unsigned job_ceiling                  = NO_JOB_RUNNING;
+
 uint32_t enabled_irqs;
 int nesting = 0;
 
-static uint32_t idle_task_stack[48] __ALIGNED(8);
+static uint32_t idle_task_stack[IDLE_TASK_STACK_WORDS] __ALIGNED(8);
 static task_t idle_task;
 
+#ifdef M0RTOS_HOST
+/* The port layer (critical sections, task stacks, yield and interrupts) is in host/ */
+extern void _enter_critical(void);
+extern void _exit_critical(void);
+extern uint32_t *create_task_stack(task_function_t *task_function, uint32_t *stack, unsigned stack_words);
+extern void init_interrupts(void);
+extern void start_idle_task(uint32_t *idle_sp);
+#else
 /*
  * Enter critical section - prevent all interrupts below realtime priority
  * Calls to this function cannot be nested with the same enabled_irqs address
  */
+#ifdef KERNEL_IN_RAM
+#pragma arm section code = "m0rtos_ram"
+#endif
 __ASM void _enter_critical()
 {
     IMPORT enabled_irqs
@@ -45,21 +84,25 @@ __ASM void _enter_critical()
     
     ALIGN 4
 }
+#ifdef KERNEL_IN_RAM
+#pragma arm section code
+#endif
 
 /*
  * Exit critical section - return interrupt mask to what it was before
  * Calls to this function cannot be nested
  */
-void _exit_critical()
+KERNEL_RAM_CODE void _exit_critical()
 {
     NVIC->ISER[0] = enabled_irqs;
 }
+#endif /* M0RTOS_HOST */
 
 /*
  * Enter critical section in task context
  * Calls to this function can be nested within a task
  */
-void enter_critical(void)
+KERNEL_RAM_CODE void enter_critical(void)
 {
     if (nesting == 0)
     {
@@ -72,7 +115,7 @@ void enter_critical(void)
  * Exit critical section in task context
  * Calls to this function can be nested within a task
  */
-void exit_critical(void)
+KERNEL_RAM_CODE void exit_critical(void)
 {
     --nesting;
     if (nesting == 0)
@@ -92,6 +135,7 @@ void task_returned(void)
     }
 }
 
+#ifndef M0RTOS_HOST
 /*
  * Set up stack contents as if the task_function just got swapped out (see task_switch)
  * stack must be 8 byte aligned
@@ -107,6 +151,7 @@ static uint32_t *create_task_stack(task_function_t *task_function, uint32_t *sta
     }
     return stack + stack_words - 16;
 }
+#endif /* M0RTOS_HOST */
 
 /*
  * Add a new task
@@ -117,54 +162,152 @@ int add_task(task_function_t *task_function, task_t *task, uint32_t *stack, unsi
              unsigned priority)
 {
     task->sp             = create_task_stack(task_function, stack, stack_words);
-    task->stack          = stack;
-    task->stack_words    = stack_words;
     task->priority       = priority;
     task->flags          = TASK_RUNNABLE;
     task->next_suspended = NULL;
-    task->next_task      = task_list;
+    task->period         = 0;
+#ifdef EDF_TASK_PRIO
+    task->deadline       = 0;
+#endif
+#ifdef USE_SUPERVISOR
+    task->next_supervised   = NULL;
+    task->check_in_timeout  = 0;
+#endif
     task->next_runnable  = runnable_list[priority];
-    task_list               = task;
     runnable_list[priority] = task;
     return 0;
 }
 
 /*
- * Wake up all the tasks that are blocked on a queue
+ * Add all the tasks in a table made by DECLARE_TASK_TABLE
+ * The table can live in flash: only the task_t structures and stacks need RAM.
+ */
+int add_task_table(const task_desc_t *table, unsigned num_tasks)
+{
+    unsigned i;
+
+    for (i = 0; i < num_tasks; ++i)
+    {
+        add_task(table[i].function, table[i].task, table[i].stack, table[i].stack_words,
+                 table[i].priority);
+    }
+    return 0;
+}
+
+/*
+ * Take a task off the blocked list it is on, in constant time
+ * Must be called inside a critical section
+ */
+KERNEL_RAM_CODE static void unlink_blocked(task_t *task)
+{
+    *task->pprev_blocked = task->next_blocked;
+    if (task->next_blocked)
+    {
+        task->next_blocked->pprev_blocked = task->pprev_blocked;
+    }
+    task->pprev_blocked = NULL;
+}
+
+/*
+ * Wake up all the tasks on a blocked list
  * Must be called inside a critical section
  */
-static bool wake_tasks_blocked_on_queue(queue_t *q)
+KERNEL_RAM_CODE static bool wake_tasks_blocked_on_list(task_t **blocked_list)
 {
     task_t *task;
     
     /* See if there are some tasks to unblock */
-    task = q->blocked_list;
+    task = *blocked_list;
     while (task)
     {
-        task->wait_for = NULL;
+        task->pprev_blocked = NULL;
         task = task->next_blocked;
     }
-    if (q->blocked_list)
+    if (*blocked_list)
     {
-        q->blocked_list = NULL;
+        *blocked_list = NULL;
         return true;
     }
     return false;
 }
 
 /*
- * Suspend the current task on a queue, with optional wake-up time
+ * Wake up all the tasks that are blocked on a queue, and on the queue set it belongs to
+ * Must be called inside a critical section
+ */
+KERNEL_RAM_CODE static bool wake_tasks_blocked_on_queue(queue_t *q)
+{
+    bool woken = false;
+    
+    if (wake_tasks_blocked_on_list(&q->blocked_list))
+    {
+        woken = true;
+    }
+    if (q->set && wake_tasks_blocked_on_queue(q->set))
+    {
+        woken = true;
+    }
+    return woken;
+}
+
+/*
+ * Mark a job as pending, in priority order, and wake the job runner if it is waiting
+ * Must be called inside a critical section
+ */
+KERNEL_RAM_CODE static bool _activate_job(job_t *job)
+{
+    job_t **pprev;
+
+    if (job->pending)
+    {
+        return false;
+    }
+    job->pending = true;
+    pprev = &pending_jobs;
+    while (*pprev && (*pprev)->priority <= job->priority)
+    {
+        pprev = &(*pprev)->next_pending;
+    }
+    job->next_pending = *pprev;
+    *pprev = job;
+
+    return wake_tasks_blocked_on_list(&job_runner_blocked);
+}
+
+/*
+ * After writing to a queue, wake up the readers and activate any job attached to the queue
+ * Must be called inside a critical section
+ */
+KERNEL_RAM_CODE static bool wake_queue_readers(queue_t *q)
+{
+    bool woken;
+
+    woken = wake_tasks_blocked_on_queue(q);
+    if (q->job && _activate_job(q->job))
+    {
+        woken = true;
+    }
+    return woken;
+}
+
+/*
+ * Suspend the current task on a blocked list (e.g. a queue's), with optional wake-up time
  * Must be called inside a critical section
  */
-static void block_on_queue(queue_t *q, bool sleep, uint32_t target_ticks)
+KERNEL_RAM_CODE static void block_on_list(task_t **blocked_list, bool sleep, uint32_t target_ticks)
 {
     unsigned p;
 
     /* Move this task to the blocked list and the suspended list */
     p = running_task->priority;
     runnable_list[p] = runnable_list[p]->next_runnable;
-    running_task->next_blocked = q->blocked_list;
-    q->blocked_list = running_task;
+    running_task->next_blocked = *blocked_list;
+    if (*blocked_list)
+    {
+        (*blocked_list)->pprev_blocked = &running_task->next_blocked;
+    }
+    *blocked_list = running_task;
+    running_task->pprev_blocked = blocked_list;
     running_task->next_suspended = suspended_list;
     suspended_list = running_task;
     if (sleep)
@@ -176,21 +319,109 @@ static void block_on_queue(queue_t *q, bool sleep, uint32_t target_ticks)
     {
         running_task->flags |= TASK_BLOCKED;
     }
-    running_task->wait_for = q;
 }
 
+#ifdef USE_QUEUE_STATS
+/*
+ * Count bytes (and a message) through a queue, and after a write note the peak fill level
+ * Must be called inside a critical section
+ */
+KERNEL_RAM_CODE static void queue_stats_transfer(queue_t *q, unsigned bytes, bool write,
+                                                  bool message)
+{
+    int level;
+
+    if (write)
+    {
+        q->stats.bytes_written += bytes;
+        q->stats.messages_written += message;
+        level = q->in - q->out;
+        if (level < 0)
+        {
+            level += q->max;
+        }
+        if (level > q->stats.peak_level)
+        {
+            q->stats.peak_level = level;
+        }
+    }
+    else
+    {
+        q->stats.bytes_read += bytes;
+        q->stats.messages_read += message;
+    }
+}
+
+/*
+ * Count a timeout, and if the caller blocked, the ticks since it was called
+ * Must be called inside a critical section
+ */
+KERNEL_RAM_CODE static void queue_stats_wait_over(queue_t *q, bool waited, bool timed_out,
+                                                   uint32_t start_ticks)
+{
+    if (timed_out)
+    {
+        ++q->stats.timeouts;
+    }
+    if (waited)
+    {
+        q->stats.blocked_ticks += ticks - start_ticks;
+    }
+}
+
+/*
+ * Name a queue and add it to the list that next_registered_queue() goes through
+ * Register each queue once, before it is used
+ */
+void register_queue(queue_t *q, const char *name)
+{
+    enter_critical();
+    q->stats.name = name;
+    q->next_registered = registered_queues;
+    registered_queues = q;
+    exit_critical();
+}
+
+/*
+ * Go through the registered queues: pass NULL for the first one, and the previous one for
+ * the next. Returns NULL at the end. Queues can't be unregistered, so no locking is needed.
+ */
+queue_t *next_registered_queue(queue_t *q)
+{
+    return q ? q->next_registered : registered_queues;
+}
+
+/*
+ * Take a consistent copy of a queue's statistics, optionally zeroing them
+ */
+void get_queue_stats(queue_t *q, queue_stats_t *stats, bool reset)
+{
+    queue_stats_t empty = {0};
+
+    enter_critical();
+    *stats = q->stats;
+    if (reset)
+    {
+        empty.name = q->stats.name;
+        q->stats = empty;
+    }
+    exit_critical();
+}
+#endif /* USE_QUEUE_STATS */
+
 /*
  * Read from a queue
  * Amount to be read must be <= q->max - 1
  * ticks_to_wait special values: zero (don't wait), negative (wait forever)
  * Must not be called inside a critical section or from interrupt context
  */
-bool read_queue(queue_t *q, uint8_t *buf, unsigned amount, int ticks_to_wait)
+KERNEL_RAM_CODE bool read_queue(queue_t *q, uint8_t *buf, unsigned amount, int ticks_to_wait)
 {
     bool got = false;
     int level;
     unsigned i;
     uint32_t target_ticks;
+    QUEUE_STATS(bool waited = false;)
 
     target_ticks = ticks + ticks_to_wait;
     
@@ -218,6 +449,8 @@ bool read_queue(queue_t *q, uint8_t *buf, unsigned amount, int ticks_to_wait)
             }
             /* Success */
             got = true;
+            QUEUE_STATS(queue_stats_transfer(q, amount, false, false));
+            QUEUE_STATS(queue_stats_wait_over(q, waited, false, target_ticks - ticks_to_wait));
             if (wake_tasks_blocked_on_queue(q))
             {
                 yield();
@@ -230,10 +463,12 @@ bool read_queue(queue_t *q, uint8_t *buf, unsigned amount, int ticks_to_wait)
             if (ticks_to_wait == 0 || ((ticks_to_wait > 0) && (int32_t)(target_ticks - ticks) <= 0))
             {
                 /* Failure: give up waiting */
+                QUEUE_STATS(queue_stats_wait_over(q, waited, ticks_to_wait != 0, target_ticks - ticks_to_wait));
                 exit_critical();
                 break;
             }
-            block_on_queue(q, ticks_to_wait > 0, target_ticks);
+            QUEUE_STATS(++q->stats.reader_blocks; waited = true);
+            block_on_list(&q->blocked_list, ticks_to_wait > 0, target_ticks);
             yield();
         }
         
@@ -248,7 +483,7 @@ bool read_queue(queue_t *q, uint8_t *buf, unsigned amount, int ticks_to_wait)
  * Amount to be read must be <= q->max - 1
  * Must only called from interrupt context
  */
-bool read_queue_irq(queue_t *q, uint8_t *buf, unsigned amount)
+KERNEL_RAM_CODE bool read_queue_irq(queue_t *q, uint8_t *buf, unsigned amount)
 {
     bool got = false;
     int level;
@@ -276,6 +511,7 @@ bool read_queue_irq(queue_t *q, uint8_t *buf, unsigned amount)
         }
         /* Success */
         got = true;
+        QUEUE_STATS(queue_stats_transfer(q, amount, false, false));
         if (wake_tasks_blocked_on_queue(q))
         {
             yield();
@@ -292,12 +528,13 @@ bool read_queue_irq(queue_t *q, uint8_t *buf, unsigned amount)
  * ticks_to_wait special values: zero (don't wait), negative (wait forever)
  * Must not be called inside a critical section or from interrupt context
  */
-bool write_queue(queue_t *q, const uint8_t *buf, unsigned amount, int ticks_to_wait)
+KERNEL_RAM_CODE bool write_queue(queue_t *q, const uint8_t *buf, unsigned amount, int ticks_to_wait)
 {
     bool put = false;
     int level;
     unsigned i;
     uint32_t target_ticks;
+    QUEUE_STATS(bool waited = false;)
 
     target_ticks = ticks + ticks_to_wait;
     
@@ -323,11 +560,13 @@ bool write_queue(queue_t *q, const uint8_t *buf, unsigned amount, int ticks_to_w
                     q->in -= q->max;
                 }
             }
-            if (wake_tasks_blocked_on_queue(q))
+            if (wake_queue_readers(q))
             {
                 yield();
             }
             put = true;
+            QUEUE_STATS(queue_stats_transfer(q, amount, true, false));
+            QUEUE_STATS(queue_stats_wait_over(q, waited, false, target_ticks - ticks_to_wait));
             exit_critical();
             break;
         }
@@ -336,10 +575,12 @@ bool write_queue(queue_t *q, const uint8_t *buf, unsigned amount, int ticks_to_w
             if (ticks_to_wait == 0 || ((ticks_to_wait > 0) && (int32_t)(target_ticks - ticks) <= 0))
             {
                 /* Failure: give up waiting */
+                QUEUE_STATS(queue_stats_wait_over(q, waited, ticks_to_wait != 0, target_ticks - ticks_to_wait));
                 exit_critical();
                 break;
             }
-            block_on_queue(q, ticks_to_wait > 0, target_ticks);
+            QUEUE_STATS(++q->stats.writer_blocks; waited = true);
+            block_on_list(&q->blocked_list, ticks_to_wait > 0, target_ticks);
             yield();
         }
         
@@ -354,7 +595,7 @@ bool write_queue(queue_t *q, const uint8_t *buf, unsigned amount, int ticks_to_w
  * Amount to be written must be <= q->max - 1
  * Must only be called from interrupt context
  */
-bool write_queue_irq(queue_t *q, const uint8_t *buf, unsigned amount)
+KERNEL_RAM_CODE bool write_queue_irq(queue_t *q, const uint8_t *buf, unsigned amount)
 {
     bool put = false;
     int level;
@@ -380,178 +621,1047 @@ bool write_queue_irq(queue_t *q, const uint8_t *buf, unsigned amount)
                 q->in -= q->max;
             }
         }
-        if (wake_tasks_blocked_on_queue(q))
+        if (wake_queue_readers(q))
         {
             yield();
         }
         put = true;
+        QUEUE_STATS(queue_stats_transfer(q, amount, true, false));
     }
    
     _exit_critical();
     return put;
 }
 
-void sleep_until(uint32_t target_ticks)
-{
-    unsigned p;
-    
-    /* Block interrupts and move this task to the suspended list */
-    enter_critical();
-    running_task->flags |= TASK_SLEEPING;
-    running_task->wait_until = target_ticks;
-    p = running_task->priority;
-    runnable_list[p] = runnable_list[p]->next_runnable;
-    running_task->next_suspended = suspended_list;
-    suspended_list = running_task;
-    yield();
-    exit_critical();
-}
-
-void sleep(uint32_t ticks_to_sleep)
-{
-    sleep_until(ticks + ticks_to_sleep);
-}
-
-void tick(void)
+/*
+ * Store a length-prefixed message in a queue, if there is room
+ * Messages are never split across the end of the buffer, so they can be read in place. If one
+ * doesn't fit at the end, a zero length byte tells the reader to continue from the start.
+ * Must be called inside a critical section
+ */
+static bool put_message(queue_t *q, const uint8_t *buf, unsigned length)
 {
-    bool need_yield = false;
-    task_t *temp;
-
-    ++ticks;
+    unsigned i, need, space;
 
-    /* Is there another task ready to run at this priority? */
-    if (running_task->next_runnable)
+    /* An empty buffer can start again from the beginning */
+    if (q->in == q->out)
     {
-        need_yield = true;
+        q->in  = 0;
+        q->out = 0;
     }
-    else
+
+    need = length + 1;
+    if (q->in >= q->out)
     {
-        /* Or has a task woken from sleep? */
-        for (temp = suspended_list; temp; temp = temp->next_suspended)
+        /* Free space runs to the end of the buffer (but we always leave 1 byte empty) */
+        space = q->max - q->in - (q->out == 0 ? 1 : 0);
+        if (need > space)
         {
-            /* Is this task ready to wake? */
-            if ((temp->flags & TASK_SLEEPING) && (int32_t)(temp->wait_until - ticks) <= 0)
+            /* Not enough room at the end, so try the start */
+            if (q->out == 0 || need > q->out - 1)
             {
-                need_yield = true;
-                break;
+                return false;
             }
+            q->bytes[q->in] = 0;
+            q->in = 0;
         }
     }
-                
-    if (need_yield)
+    else if (need > q->out - q->in - 1)
     {
-        yield();
+        return false;
+    }
+
+    q->bytes[q->in] = (uint8_t)length;
+    for (i = 0; i < length; ++i)
+    {
+        q->bytes[q->in + 1 + i] = buf[i];
     }
+    q->in += need;
+    if (q->in >= q->max)
+    {
+        q->in -= q->max;
+    }
+    return true;
 }
 
-void yield(void)
+/*
+ * Find the oldest message in a queue, without removing it
+ * Returns a pointer to the message in the queue's buffer, or NULL if there isn't one
+ * Must be called inside a critical section
+ */
+static const uint8_t *find_message(queue_t *q, unsigned *length)
 {
-    NVIC->ISPR[0] = YIELD_BIT;
+    if (q->in == q->out)
+    {
+        return NULL;
+    }
+    if (q->bytes[q->out] == 0)
+    {
+        /* The next message was stored at the start of the buffer */
+        q->out = 0;
+    }
+    *length = q->bytes[q->out];
+    return &q->bytes[q->out + 1];
 }
 
 /*
- * This function may be called from a real-time IRQ to wake a sleeping task
- * If the task is not sleeping, has no effect other than a yield.
+ * Remove the oldest message from a queue
+ * Must be called inside a critical section, after find_message() has found it
  */
-void wake_task_realtime(task_t *task)
+static void drop_message(queue_t *q)
 {
-    task->wait_until = ticks;
-    yield();
+    q->out += q->bytes[q->out] + 1;
+    if (q->out >= q->max)
+    {
+        q->out -= q->max;
+    }
 }
 
-uint32_t *choose_next_task(uint32_t *current_sp)
+/*
+ * Write a message (1-255 bytes) to a message buffer, all in one piece
+ * The buffer needs room for the message plus a length byte, and messages are never split, so
+ * size the buffer for at least two of your largest messages.
+ * ticks_to_wait special values: zero (don't wait), negative (wait forever)
+ * Must not be called inside a critical section or from interrupt context
+ */
+bool write_message(queue_t *q, const uint8_t *buf, unsigned length, int ticks_to_wait)
 {
-    unsigned p;
-    task_t *task, *taskb, **pprev, **pprevb, *insert_point;
-    
-    /* Save the outgoing task's stack pointer */
-    running_task->sp = current_sp;
-    
-    /* Find highest priority runnable task */
-    for (p = 0; p < NUM_TASK_PRIOS; ++p)
+    bool put = false;
+    uint32_t target_ticks;
+    QUEUE_STATS(bool waited = false;)
+
+    if (length == 0 || length > UINT8_MAX)
     {
-        if (runnable_list[p] == NULL)
-        {
-            /* Check next lowest priority task list */
-            continue;
-        }
-        if (runnable_list[p] == running_task)
-        {
-            /* Current task still runnable, round robin to next task if there is one */
-            task = runnable_list[p];
-            runnable_list[p] = task->next_runnable;
-            if (runnable_list[p] == NULL)
-            {
-                /* No next task, keep running this one */
-                runnable_list[p] = task;
-            }
-            else
-            {
-                /* Add on task at the end */
-                task->next_runnable = NULL;
-                insert_point = runnable_list[p];
-                while (insert_point->next_runnable != NULL)
-                {
-                    insert_point = insert_point->next_runnable;
-                }
-                insert_point->next_runnable = task;
-            }
-        }
-        running_task = runnable_list[p];
-        break;
+        return false;
     }
 
-    /* Check suspended list for tasks that need to wake up from sleep or being blocked */
-    pprev = &suspended_list;
-    for (task = suspended_list; task; task = task->next_suspended)
+    target_ticks = ticks + ticks_to_wait;
+
+    while (true)
     {
-        /* Is this task ready to wake/unblock? */
-        if (  ((task->flags & TASK_SLEEPING) && ((int32_t)(task->wait_until - ticks) <= 0))
-           || ((task->flags & TASK_BLOCKED)  && (task->wait_for == NULL)))
+        enter_critical();
+
+        if (put_message(q, buf, length))
         {
-            /* Remove this task from the suspended list - update previous next_suspended value */
-            *pprev = task->next_suspended;
-            /* Remove a timed-out task from the queue's list */
-            if (task->wait_for != NULL)
-            {
-                pprevb = &task->wait_for->blocked_list;
-                for (taskb = task->wait_for->blocked_list; task; task = task->next_blocked)
-                {
-                    if (taskb == task)
-                    {
-                        *pprevb = task->next_blocked;
-                        break;
-                    }
-                    pprevb = &taskb->next_blocked;
-                }
-                task->wait_for = NULL;
-            }
-            /* Add task to the correct runnable list */
-            task->flags = TASK_RUNNABLE;
-            task->next_runnable = runnable_list[task->priority];
-            runnable_list[task->priority] = task;
-            /* Check if we should actually be running this task */
-            if (task->priority <= running_task->priority)
+            if (wake_queue_readers(q))
             {
-                running_task = task;
+                yield();
             }
+            put = true;
+            QUEUE_STATS(queue_stats_transfer(q, length, true, true));
+            QUEUE_STATS(queue_stats_wait_over(q, waited, false, target_ticks - ticks_to_wait));
+            exit_critical();
+            break;
         }
         else
         {
-            /* This task stays on the suspended list, update pprev */
-            pprev = &task->next_suspended;
+            if (ticks_to_wait == 0 || ((ticks_to_wait > 0) && (int32_t)(target_ticks - ticks) <= 0))
+            {
+                /* Failure: give up waiting */
+                QUEUE_STATS(queue_stats_wait_over(q, waited, ticks_to_wait != 0, target_ticks - ticks_to_wait));
+                exit_critical();
+                break;
+            }
+            QUEUE_STATS(++q->stats.writer_blocks; waited = true);
+            block_on_list(&q->blocked_list, ticks_to_wait > 0, target_ticks);
+            yield();
         }
+
+        exit_critical();
     }
 
-    /* Return incoming task's stack pointer */
-    return running_task->sp;
+    return put;
 }
 
-__ASM void Yield_IRQHandler(void)
+/*
+ * Write a message (1-255 bytes) to a message buffer from IRQ context
+ * Must only be called from interrupt context
+ */
+bool write_message_irq(queue_t *q, const uint8_t *buf, unsigned length)
 {
-    IMPORT choose_next_task
-    IMPORT _exit_critical
-    /* 
+    bool put = false;
+
+    if (length == 0 || length > UINT8_MAX)
+    {
+        return false;
+    }
+
+    _enter_critical();
+
+    if (put_message(q, buf, length))
+    {
+        if (wake_queue_readers(q))
+        {
+            yield();
+        }
+        put = true;
+        QUEUE_STATS(queue_stats_transfer(q, length, true, true));
+    }
+
+    _exit_critical();
+    return put;
+}
+
+/*
+ * Read a whole message from a message buffer
+ * Returns the length of the message, or zero if we timed out. If the message is longer than
+ * max_length only the start of it is copied, but all of it is removed from the buffer.
+ * ticks_to_wait special values: zero (don't wait), negative (wait forever)
+ * Must not be called inside a critical section or from interrupt context
+ */
+unsigned read_message(queue_t *q, uint8_t *buf, unsigned max_length, int ticks_to_wait)
+{
+    unsigned length = 0, i;
+    const uint8_t *message;
+    uint32_t target_ticks;
+    QUEUE_STATS(bool waited = false;)
+
+    target_ticks = ticks + ticks_to_wait;
+
+    while (true)
+    {
+        enter_critical();
+
+        message = find_message(q, &length);
+        if (message)
+        {
+            for (i = 0; i < length && i < max_length; ++i)
+            {
+                buf[i] = message[i];
+            }
+            drop_message(q);
+            QUEUE_STATS(queue_stats_transfer(q, length, false, true));
+            QUEUE_STATS(queue_stats_wait_over(q, waited, false, target_ticks - ticks_to_wait));
+            if (wake_tasks_blocked_on_queue(q))
+            {
+                yield();
+            }
+            exit_critical();
+            break;
+        }
+        else
+        {
+            if (ticks_to_wait == 0 || ((ticks_to_wait > 0) && (int32_t)(target_ticks - ticks) <= 0))
+            {
+                /* Failure: give up waiting */
+                QUEUE_STATS(queue_stats_wait_over(q, waited, ticks_to_wait != 0, target_ticks - ticks_to_wait));
+                exit_critical();
+                break;
+            }
+            QUEUE_STATS(++q->stats.reader_blocks; waited = true);
+            block_on_list(&q->blocked_list, ticks_to_wait > 0, target_ticks);
+            yield();
+        }
+
+        exit_critical();
+    }
+
+    return length;
+}
+
+/*
+ * Read a whole message from a message buffer from IRQ context
+ * Returns the length of the message, or zero if there wasn't one
+ * Must only be called from interrupt context
+ */
+unsigned read_message_irq(queue_t *q, uint8_t *buf, unsigned max_length)
+{
+    unsigned length = 0, i;
+    const uint8_t *message;
+
+    _enter_critical();
+
+    message = find_message(q, &length);
+    if (message)
+    {
+        for (i = 0; i < length && i < max_length; ++i)
+        {
+            buf[i] = message[i];
+        }
+        drop_message(q);
+        QUEUE_STATS(queue_stats_transfer(q, length, false, true));
+        if (wake_tasks_blocked_on_queue(q))
+        {
+            yield();
+        }
+    }
+
+    _exit_critical();
+    return length;
+}
+
+/*
+ * Wait for a message and return a pointer to it, still inside the message buffer
+ * The message stays put until release_message(), so only one task may read a buffer this way.
+ * Returns NULL if we timed out.
+ * ticks_to_wait special values: zero (don't wait), negative (wait forever)
+ * Must not be called inside a critical section or from interrupt context
+ */
+const uint8_t *peek_message(queue_t *q, unsigned *length, int ticks_to_wait)
+{
+    const uint8_t *message;
+    uint32_t target_ticks;
+    QUEUE_STATS(bool waited = false;)
+
+    target_ticks = ticks + ticks_to_wait;
+
+    while (true)
+    {
+        enter_critical();
+
+        message = find_message(q, length);
+        if (message)
+        {
+            QUEUE_STATS(queue_stats_wait_over(q, waited, false, target_ticks - ticks_to_wait));
+            exit_critical();
+            break;
+        }
+        if (ticks_to_wait == 0 || ((ticks_to_wait > 0) && (int32_t)(target_ticks - ticks) <= 0))
+        {
+            /* Failure: give up waiting */
+            QUEUE_STATS(queue_stats_wait_over(q, waited, ticks_to_wait != 0, target_ticks - ticks_to_wait));
+            exit_critical();
+            break;
+        }
+        QUEUE_STATS(++q->stats.reader_blocks; waited = true);
+        block_on_list(&q->blocked_list, ticks_to_wait > 0, target_ticks);
+        yield();
+
+        exit_critical();
+    }
+
+    return message;
+}
+
+/*
+ * Remove the message returned by peek_message(), making room for writers
+ * Must not be called inside a critical section or from interrupt context
+ */
+void release_message(queue_t *q)
+{
+    enter_critical();
+    QUEUE_STATS(queue_stats_transfer(q, q->bytes[q->out], false, true));
+    drop_message(q);
+    if (wake_tasks_blocked_on_queue(q))
+    {
+        yield();
+    }
+    exit_critical();
+}
+
+/*
+ * Wait until any one of several queues can be read from (or written to)
+ * Each entry says how many bytes must be available to read, or free to write.
+ * Returns the index of the first ready entry, or -1 if we timed out. Nothing is transferred, so
+ * follow up with a non-blocking read_queue() or write_queue() on the queue that is ready.
+ * The queues are added to set, and a queue can only belong to one set at a time.
+ * ticks_to_wait special values: zero (don't wait), negative (wait forever)
+ * Must not be called inside a critical section or from interrupt context
+ */
+int select_queue(queue_t *set, const queue_select_t *selects, unsigned num_selects,
+                 int ticks_to_wait)
+{
+    int ready = -1;
+    int level;
+    unsigned i;
+    queue_t *q;
+    uint32_t target_ticks;
+
+    target_ticks = ticks + ticks_to_wait;
+
+    while (true)
+    {
+        enter_critical();
+
+        for (i = 0; i < num_selects; ++i)
+        {
+            q = selects[i].queue;
+            q->set = set;
+            level = q->in - q->out;
+            if (level < 0)
+            {
+                level += q->max;
+            }
+            if (selects[i].write ? (level + selects[i].amount < q->max)
+                                 : (level >= selects[i].amount))
+            {
+                ready = i;
+                break;
+            }
+        }
+        if (ready >= 0)
+        {
+            exit_critical();
+            break;
+        }
+        if (ticks_to_wait == 0 || ((ticks_to_wait > 0) && (int32_t)(target_ticks - ticks) <= 0))
+        {
+            /* Failure: give up waiting */
+            exit_critical();
+            break;
+        }
+        block_on_list(&set->blocked_list, ticks_to_wait > 0, target_ticks);
+        yield();
+
+        exit_critical();
+    }
+
+    return ready;
+}
+
+/*
+ * Decide whether the flags in an event group satisfy a wait for bits
+ */
+static bool event_bits_met(uint32_t flags, uint32_t bits, bool all)
+{
+    if (all)
+    {
+        return (flags & bits) == bits;
+    }
+    return (flags & bits) != 0;
+}
+
+/*
+ * Set bits in an event group, and wake up the tasks whose waits are now satisfied
+ * Each waiter's mask is checked once, and the others stay blocked. Setting any of the bits
+ * an attached job is waiting for activates it too.
+ * Must be called inside a critical section
+ */
+static bool _set_event_bits(event_group_t *group, uint32_t bits)
+{
+    task_t *task, *next;
+    uint32_t clear = 0;
+    bool woken = false;
+
+    group->flags |= bits;
+    for (task = group->blocked_list; task; task = next)
+    {
+        next = task->next_blocked;
+        if (event_bits_met(group->flags, task->event_mask, task->flags & TASK_WAIT_ALL))
+        {
+            /* Tell the task which bits woke it, and take it off the blocked list */
+            task->event_bits = group->flags;
+            if (task->flags & TASK_CLEAR_ON_EXIT)
+            {
+                clear |= task->event_mask;
+            }
+            unlink_blocked(task);
+            woken = true;
+        }
+    }
+    /* Clear bits after checking every waiter, so they all see the same flags */
+    group->flags &= ~clear;
+
+    if ((bits & group->job_bits) && _activate_job(group->job))
+    {
+        woken = true;
+    }
+    return woken;
+}
+
+/*
+ * Wait for any (or with EVENT_WAIT_ALL, all) of bits to be set in an event group
+ * With EVENT_CLEAR_ON_EXIT, the bits waited for are cleared when the wait is satisfied.
+ * Returns the group's flags at the moment the wait was satisfied, or zero if we timed out.
+ * There's nothing to wait for if bits is zero, so that returns zero straight away.
+ * ticks_to_wait special values: zero (don't wait), negative (wait forever)
+ * Must not be called inside a critical section or from interrupt context
+ */
+uint32_t wait_event_bits(event_group_t *group, uint32_t bits, unsigned options, int ticks_to_wait)
+{
+    uint32_t got = 0;
+    uint32_t target_ticks;
+
+    if (bits == 0)
+    {
+        return 0;
+    }
+    target_ticks = ticks + ticks_to_wait;
+
+    enter_critical();
+    if (event_bits_met(group->flags, bits, options & EVENT_WAIT_ALL))
+    {
+        /* Already satisfied */
+        got = group->flags;
+        if (options & EVENT_CLEAR_ON_EXIT)
+        {
+            group->flags &= ~bits;
+        }
+        exit_critical();
+    }
+    else if (ticks_to_wait != 0)
+    {
+        /* Block until a setter finds our wait satisfied (it fills in event_bits) or we time out */
+        running_task->event_mask = bits;
+        running_task->event_bits = 0;
+        block_on_list(&group->blocked_list, ticks_to_wait > 0, target_ticks);
+        if (options & EVENT_WAIT_ALL)
+        {
+            running_task->flags |= TASK_WAIT_ALL;
+        }
+        if (options & EVENT_CLEAR_ON_EXIT)
+        {
+            running_task->flags |= TASK_CLEAR_ON_EXIT;
+        }
+        yield();
+        exit_critical();
+
+        /* We are running again */
+        enter_critical();
+        got = running_task->event_bits;
+        exit_critical();
+    }
+    else
+    {
+        exit_critical();
+    }
+
+    return got;
+}
+
+/*
+ * Set bits in an event group, returning the flags afterwards
+ * Must not be called inside a critical section or from interrupt context
+ */
+uint32_t set_event_bits(event_group_t *group, uint32_t bits)
+{
+    uint32_t flags;
+
+    enter_critical();
+    if (_set_event_bits(group, bits))
+    {
+        yield();
+    }
+    flags = group->flags;
+    exit_critical();
+    return flags;
+}
+
+/*
+ * Set bits in an event group from IRQ context, returning the flags afterwards
+ * Must only be called from interrupt context
+ */
+uint32_t set_event_bits_irq(event_group_t *group, uint32_t bits)
+{
+    uint32_t flags;
+
+    _enter_critical();
+    if (_set_event_bits(group, bits))
+    {
+        yield();
+    }
+    flags = group->flags;
+    _exit_critical();
+    return flags;
+}
+
+/*
+ * Clear bits in an event group, returning the flags before they were cleared
+ * Must not be called inside a critical section or from interrupt context
+ */
+uint32_t clear_event_bits(event_group_t *group, uint32_t bits)
+{
+    uint32_t flags;
+
+    enter_critical();
+    flags = group->flags;
+    group->flags &= ~bits;
+    exit_critical();
+    return flags;
+}
+
+/*
+ * Clear bits in an event group from IRQ context, returning the flags before they were cleared
+ * Must only be called from interrupt context
+ */
+uint32_t clear_event_bits_irq(event_group_t *group, uint32_t bits)
+{
+    uint32_t flags;
+
+    _enter_critical();
+    flags = group->flags;
+    group->flags &= ~bits;
+    _exit_critical();
+    return flags;
+}
+
+/*
+ * Run pending jobs with a higher priority (lower number) than ceiling, highest first
+ * Jobs are ordinary function calls on the job runner's stack, so a job that activates a higher
+ * priority job is pre-empted by nesting that job's call inside its own.
+ */
+static void run_jobs(unsigned ceiling)
+{
+    job_t *job;
+
+    while (true)
+    {
+        enter_critical();
+        job = pending_jobs;
+        if (job == NULL || job->priority >= ceiling)
+        {
+            exit_critical();
+            break;
+        }
+        pending_jobs = job->next_pending;
+        job->pending = false;
+        job_ceiling = job->priority;
+        exit_critical();
+
+        job->function(job->arg);
+        job_ceiling = ceiling;
+    }
+}
+
+/*
+ * Task function that runs jobs to completion, one after another, all on its own stack
+ * Add it with add_task() at whatever priority the jobs should have relative to other tasks,
+ * and size its stack for the deepest nesting of jobs you expect.
+ */
+__NO_RETURN void job_runner(void *arg)
+{
+    job_runner_task = running_task;
+    while (1)
+    {
+        run_jobs(NO_JOB_RUNNING);
+        enter_critical();
+        if (pending_jobs == NULL)
+        {
+            block_on_list(&job_runner_blocked, false, 0);
+            yield();
+        }
+        exit_critical();
+    }
+}
+
+/*
+ * Activate a job: it will run to completion on the job runner's stack
+ * From inside a job, a higher priority job runs straight away, before this returns. From a
+ * task, if the job runner is part way through a job, the new job runs after that one returns,
+ * even if the new job has a higher priority, as with activate_job_irq().
+ * Must not be called inside a critical section or from interrupt context
+ */
+void activate_job(job_t *job)
+{
+    enter_critical();
+    if (_activate_job(job))
+    {
+        yield();
+    }
+    exit_critical();
+
+    if (running_task == job_runner_task)
+    {
+        run_jobs(job_ceiling);
+    }
+}
+
+/*
+ * Activate a job from IRQ context
+ * The job runs when the job runner is next scheduled. If a job is already running, the new job
+ * runs after it completes, even if the new job has a higher priority.
+ * Must only be called from interrupt context
+ */
+void activate_job_irq(job_t *job)
+{
+    _enter_critical();
+    if (_activate_job(job))
+    {
+        yield();
+    }
+    _exit_critical();
+}
+
+/*
+ * Activate job every time something is written to q
+ */
+void attach_job(queue_t *q, job_t *job)
+{
+    enter_critical();
+    q->job = job;
+    exit_critical();
+}
+
+/*
+ * Activate job every time any of bits is set in group (even if it was already set)
+ * Only one job can be attached to a group; a NULL job or bits of zero detaches it.
+ */
+void attach_event_job(event_group_t *group, uint32_t bits, job_t *job)
+{
+    enter_critical();
+    group->job      = job;
+    group->job_bits = job ? bits : 0;
+    exit_critical();
+}
+
+KERNEL_RAM_CODE void sleep_until(uint32_t target_ticks)
+{
+    unsigned p;
+    
+    /* Block interrupts and move this task to the suspended list */
+    enter_critical();
+    running_task->flags |= TASK_SLEEPING;
+    running_task->wait_until = target_ticks;
+    p = running_task->priority;
+    runnable_list[p] = runnable_list[p]->next_runnable;
+    running_task->next_suspended = suspended_list;
+    suspended_list = running_task;
+    yield();
+    exit_critical();
+}
+
+KERNEL_RAM_CODE void sleep(uint32_t ticks_to_sleep)
+{
+    sleep_until(ticks + ticks_to_sleep);
+}
+
+/*
+ * Make a task periodic: it is released every period ticks, starting now, and each release
+ * must complete within relative_deadline ticks. The deadline orders EDF_TASK_PRIO tasks, and
+ * is ignored without EDF_TASK_PRIO.
+ */
+void set_task_period(task_t *task, uint32_t period, uint32_t relative_deadline)
+{
+    enter_critical();
+    task->release           = ticks;
+    task->period            = period;
+#ifdef EDF_TASK_PRIO
+    task->relative_deadline = relative_deadline;
+    task->deadline          = task->release + relative_deadline;
+#else
+    (void)relative_deadline;
+#endif
+    exit_critical();
+}
+
+/*
+ * Sleep until this task's next periodic release, and move its deadline on to match
+ */
+void wait_for_next_period(void)
+{
+    uint32_t release;
+
+    enter_critical();
+    running_task->release += running_task->period;
+#ifdef EDF_TASK_PRIO
+    running_task->deadline = running_task->release + running_task->relative_deadline;
+#endif
+    release = running_task->release;
+    exit_critical();
+    sleep_until(release);
+}
+
+/*
+ * Find the earliest tick at which a sleeping task (or one waiting with a timeout) is due to wake
+ * Returns false if no task is waiting for a time. Call with interrupts masked, e.g. from
+ * idle_low_power_hook(), so the answer is still true when you act on it.
+ */
+bool get_next_wakeup(uint32_t *wakeup_ticks)
+{
+    task_t *task;
+    bool found = false;
+
+    for (task = suspended_list; task; task = task->next_suspended)
+    {
+        if ((task->flags & TASK_SLEEPING) &&
+            (!found || (int32_t)(task->wait_until - *wakeup_ticks) < 0))
+        {
+            *wakeup_ticks = task->wait_until;
+            found = true;
+        }
+    }
+    return found;
+}
+
+#ifdef USE_SUPERVISOR
+/*
+ * Take a task off the supervised list
+ * Must be called inside a critical section
+ */
+static void unlink_supervised(task_t *task)
+{
+    task_t **link;
+
+    for (link = &supervised_list; *link; link = &(*link)->next_supervised)
+    {
+        if (*link == task)
+        {
+            *link = task->next_supervised;
+            break;
+        }
+    }
+}
+
+/*
+ * Put a task on the supervised list, in order of check-in deadline
+ * Must be called inside a critical section
+ */
+static void link_supervised(task_t *task)
+{
+    task_t **link;
+
+    task->check_in_deadline = ticks + task->check_in_timeout;
+    for (link = &supervised_list; *link; link = &(*link)->next_supervised)
+    {
+        if ((int32_t)(task->check_in_deadline - (*link)->check_in_deadline) < 0)
+        {
+            break;
+        }
+    }
+    task->next_supervised = *link;
+    *link = task;
+}
+
+/*
+ * From now on, the task must call supervisor_check_in() at least every timeout_ticks ticks
+ * A timeout of 0 stops supervising it. The first deadline is timeout_ticks from now.
+ */
+void supervise_task(task_t *task, uint32_t timeout_ticks)
+{
+    enter_critical();
+    if (task->check_in_timeout)
+    {
+        unlink_supervised(task);
+    }
+    task->check_in_timeout = timeout_ticks;
+    if (timeout_ticks)
+    {
+        link_supervised(task);
+    }
+    exit_critical();
+}
+
+/*
+ * Tell the supervisor the calling task is still alive, moving its deadline on
+ */
+void supervisor_check_in(void)
+{
+    enter_critical();
+    if (running_task->check_in_timeout)
+    {
+        unlink_supervised(running_task);
+        link_supervised(running_task);
+    }
+    exit_critical();
+}
+#endif /* USE_SUPERVISOR */
+
+KERNEL_RAM_CODE void tick(void)
+{
+    bool need_yield = false;
+    task_t *temp;
+
+    ++ticks;
+
+#ifdef USE_SUPERVISOR
+    /*
+     * Only the task with the earliest deadline can have missed it. Once one has, stop kicking
+     * for good and let the watchdog reset us.
+     */
+    if (supervised_list && (int32_t)(supervised_list->check_in_deadline - ticks) < 0 &&
+        !supervisor_failed_task)
+    {
+        supervisor_failed_task = supervised_list;
+    }
+    if (!supervisor_failed_task && supervisor_kick_hook)
+    {
+        supervisor_kick_hook();
+    }
+#endif
+
+    /* Is there another task ready to run at this priority? (EDF tasks don't round-robin) */
+    if (running_task->next_runnable
+#ifdef EDF_TASK_PRIO
+        && running_task->priority != EDF_TASK_PRIO
+#endif
+       )
+    {
+        need_yield = true;
+    }
+    else
+    {
+        /* Or has a task woken from sleep? */
+        for (temp = suspended_list; temp; temp = temp->next_suspended)
+        {
+            /* Is this task ready to wake? */
+            if ((temp->flags & TASK_SLEEPING) && (int32_t)(temp->wait_until - ticks) <= 0)
+            {
+                need_yield = true;
+                break;
+            }
+        }
+    }
+                
+    if (need_yield)
+    {
+        yield();
+    }
+}
+
+#ifndef M0RTOS_HOST
+KERNEL_RAM_CODE void yield(void)
+{
+    NVIC->ISPR[0] = YIELD_BIT;
+}
+#endif /* M0RTOS_HOST */
+
+/*
+ * This function may be called from a real-time IRQ to wake a sleeping task
+ * If the task is not sleeping, has no effect other than a yield.
+ */
+void wake_task_realtime(task_t *task)
+{
+    task->wait_until = ticks;
+    yield();
+}
+
+#ifdef EDF_TASK_PRIO
+/*
+ * Move the runnable task with the earliest deadline to the front of the list
+ * On a tie the task already at the front keeps its place
+ */
+KERNEL_RAM_CODE static void move_earliest_deadline_first(task_t **list)
+{
+    task_t *task, *earliest, **pprev, **pprev_earliest;
+
+    earliest = *list;
+    pprev_earliest = list;
+    for (pprev = &earliest->next_runnable; (task = *pprev) != NULL; pprev = &task->next_runnable)
+    {
+        if ((int32_t)(task->deadline - earliest->deadline) < 0)
+        {
+            earliest = task;
+            pprev_earliest = pprev;
+        }
+    }
+    if (earliest != *list)
+    {
+        *pprev_earliest = earliest->next_runnable;
+        earliest->next_runnable = *list;
+        *list = earliest;
+    }
+}
+#endif
+
+/*
+ * Decide whether a task that has just woken should run in place of the chosen task
+ */
+KERNEL_RAM_CODE static bool preempts(const task_t *task, const task_t *chosen)
+{
+#ifdef EDF_TASK_PRIO
+    if (task->priority == EDF_TASK_PRIO && chosen->priority == EDF_TASK_PRIO)
+    {
+        return (int32_t)(task->deadline - chosen->deadline) < 0;
+    }
+#endif
+    return task->priority <= chosen->priority;
+}
+
+KERNEL_RAM_CODE uint32_t *choose_next_task(uint32_t *current_sp)
+{
+    unsigned p;
+    task_t *task, **pprev, *insert_point;
+    
+    /* Save the outgoing task's stack pointer */
+    running_task->sp = current_sp;
+    
+    /* Find highest priority runnable task */
+    for (p = 0; p < NUM_TASK_PRIOS; ++p)
+    {
+        if (runnable_list[p] == NULL)
+        {
+            /* Check next lowest priority task list */
+            continue;
+        }
+#ifdef EDF_TASK_PRIO
+        if (p == EDF_TASK_PRIO)
+        {
+            /* No round robin here, just run the task with the earliest deadline */
+            move_earliest_deadline_first(&runnable_list[p]);
+        }
+        else
+#endif
+        if (runnable_list[p] == running_task)
+        {
+            /* Current task still runnable, round robin to next task if there is one */
+            task = runnable_list[p];
+            runnable_list[p] = task->next_runnable;
+            if (runnable_list[p] == NULL)
+            {
+                /* No next task, keep running this one */
+                runnable_list[p] = task;
+            }
+            else
+            {
+                /* Add on task at the end */
+                task->next_runnable = NULL;
+                insert_point = runnable_list[p];
+                while (insert_point->next_runnable != NULL)
+                {
+                    insert_point = insert_point->next_runnable;
+                }
+                insert_point->next_runnable = task;
+            }
+        }
+        running_task = runnable_list[p];
+        break;
+    }
+
+    /* Check suspended list for tasks that need to wake up from sleep or being blocked */
+    pprev = &suspended_list;
+    for (task = suspended_list; task; task = task->next_suspended)
+    {
+        /* Is this task ready to wake/unblock? */
+        if (  ((task->flags & TASK_SLEEPING) && ((int32_t)(task->wait_until - ticks) <= 0))
+           || ((task->flags & TASK_BLOCKED)  && (task->pprev_blocked == NULL)))
+        {
+            /* Remove this task from the suspended list - update previous next_suspended value */
+            *pprev = task->next_suspended;
+            /* Remove a timed-out task from the queue's list */
+            if (task->pprev_blocked != NULL)
+            {
+                unlink_blocked(task);
+            }
+            /* Add task to the correct runnable list, and check if we should actually be running it */
+            task->flags = TASK_RUNNABLE;
+            if (preempts(task, running_task))
+            {
+                task->next_runnable = runnable_list[task->priority];
+                runnable_list[task->priority] = task;
+                running_task = task;
+            }
+            else if (task->priority == running_task->priority)
+            {
+                /* Keep the chosen task at the front of its list */
+                task->next_runnable = running_task->next_runnable;
+                running_task->next_runnable = task;
+            }
+            else
+            {
+                task->next_runnable = runnable_list[task->priority];
+                runnable_list[task->priority] = task;
+            }
+        }
+        else
+        {
+            /* This task stays on the suspended list, update pprev */
+            pprev = &task->next_suspended;
+        }
+    }
+
+    /* Return incoming task's stack pointer */
+    return running_task->sp;
+}
+
+#ifndef M0RTOS_HOST
+#ifdef KERNEL_IN_RAM
+#pragma arm section code = "m0rtos_ram"
+#endif
+__ASM void Yield_IRQHandler(void)
+{
+    IMPORT choose_next_task
+    IMPORT _exit_critical
+    /* 
      * We have taken an interrupt while running the current task, so the Process Stack looks like this:
      *    ... (earlier contents of stack)
      *    xPSR
@@ -603,6 +1713,10 @@ __ASM void Yield_IRQHandler(void)
 
     ALIGN 4
 }
+#ifdef KERNEL_IN_RAM
+#pragma arm section code
+#endif
+#endif /* M0RTOS_HOST */
 
 __NO_RETURN void idle_task_function(void *arg)
 {
@@ -624,6 +1738,7 @@ __NO_RETURN void idle_task_function(void *arg)
     }
 }
 
+#ifndef M0RTOS_HOST
 __ASM void start_idle_task(uint32_t *idle_sp)
 {
     PRESERVE8
@@ -636,18 +1751,34 @@ __ASM void start_idle_task(uint32_t *idle_sp)
     bl idle_task_function
 }
 
-void __NO_RETURN start_rtos(void)
+#if defined(KERNEL_IN_RAM) && defined(__VTOR_PRESENT) && __VTOR_PRESENT
+#define VECTORS_IN_RAM
+/* 16 system exceptions and 32 interrupts. VTOR needs the table on a 256 byte boundary */
+#define NUM_VECTORS         48
+extern const uint32_t __Vectors[];
+static uint32_t ram_vectors[NUM_VECTORS] __ALIGNED(256);
+#endif
+
+/*
+ * Set interrupt priorities, and enable the yield and tick interrupts
+ */
+static void init_interrupts(void)
 {
     unsigned i;
     uint32_t priority;
-    
-    __disable_irq();
-    
-    /* Create the idle task */
-    add_task(idle_task_function, &idle_task, idle_task_stack, sizeof(idle_task_stack) / 4,
-             NUM_TASK_PRIOS - 1);
-    /* The idle task starts with an empty stack, as we call it directly */
-    idle_task.sp = idle_task_stack + sizeof(idle_task_stack) / 4;
+
+#ifdef VECTORS_IN_RAM
+    /*
+     * Fetch the vectors from RAM too, so taking an interrupt doesn't wait for the flash
+     * A plain Cortex-M0 has no VTOR, so there the vectors stay in flash
+     */
+    for (i = 0; i < NUM_VECTORS; ++i)
+    {
+        ram_vectors[i] = __Vectors[i];
+    }
+    SCB->VTOR = (uint32_t)ram_vectors;
+    __DSB();
+#endif
 
     /* Set interrupt priorities based on the bitmaps REALTIME_IRQS and LOW_PRIO_IRQS */
     for (i = 0; i < 32; ++i)
@@ -674,6 +1805,20 @@ void __NO_RETURN start_rtos(void)
     /* Enable the yield and tick interrupts */
     NVIC->ISER[0] = YIELD_BIT;
     NVIC->ISER[0] = TICK_BIT;
+}
+#endif /* M0RTOS_HOST */
+
+void __NO_RETURN start_rtos(void)
+{
+    __disable_irq();
+    
+    /* Create the idle task */
+    add_task(idle_task_function, &idle_task, idle_task_stack, sizeof(idle_task_stack) / 4,
+             NUM_TASK_PRIOS - 1);
+    /* The idle task starts with an empty stack, as we call it directly */
+    idle_task.sp = idle_task_stack + sizeof(idle_task_stack) / 4;
+
+    init_interrupts();
 
     /* Pend the interrupt that will yield to first ready task */
     yield();
@@ -7,37 +7,164 @@
 #include <cmsis_armcc.h>
 #include "m0rtos_config.h"
 
+/* Put a function in the m0rtos_ram section, which is copied to RAM at start-up */
+#ifdef KERNEL_IN_RAM
+#define KERNEL_RAM_CODE     __attribute__((section("m0rtos_ram")))
+#else
+#define KERNEL_RAM_CODE
+#endif
+
 struct queue_s;
+struct job_s;
 
 struct task_s
 {
-    struct task_s *next_task;
     struct task_s *next_runnable;
     struct task_s *next_suspended;
     struct task_s *next_blocked;
-    uint32_t *stack;
     uint32_t *sp;
-    unsigned stack_words;
     unsigned priority;
     unsigned flags;
     uint32_t wait_until;
-    struct queue_s *wait_for;
+    struct task_s **pprev_blocked;  /* Link pointing at us on a blocked list, NULL if none */
+    uint32_t release;
+    uint32_t period;
+#ifdef EDF_TASK_PRIO
+    uint32_t relative_deadline;
+    uint32_t deadline;
+#endif
+    uint32_t event_mask;
+    uint32_t event_bits;
+#ifdef USE_SUPERVISOR
+    struct task_s *next_supervised;
+    uint32_t check_in_timeout;
+    uint32_t check_in_deadline;
+#endif
 };
 
+#ifdef USE_QUEUE_STATS
+/* Counts of what has gone through a queue, and how long tasks have waited for it */
+typedef struct
+{
+    const char *name;
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint32_t messages_read;             /* Message buffers only                         */
+    uint32_t messages_written;
+    int      peak_level;                /* Most bytes held at once                      */
+    uint32_t reader_blocks;             /* Times a reader had to wait                   */
+    uint32_t writer_blocks;             /* Times a writer had to wait                   */
+    uint32_t timeouts;                  /* Reads and writes that gave up waiting        */
+    uint32_t blocked_ticks;             /* Total time spent in calls that had to wait   */
+} queue_stats_t;
+#endif
+
 struct queue_s
 {
     unsigned in, out, max;
     uint8_t *bytes;
     struct task_s *blocked_list;
+    struct queue_s *set;
+    struct job_s *job;
+#ifdef USE_QUEUE_STATS
+    queue_stats_t stats;
+    struct queue_s *next_registered;
+#endif
+};
+
+struct event_group_s
+{
+    uint32_t flags;
+    struct task_s *blocked_list;
+    struct job_s *job;
+    uint32_t job_bits;
 };
 
 typedef struct task_s task_t;
 typedef struct queue_s queue_t;
+typedef struct event_group_s event_group_t;
 typedef void (task_function_t)(void *);
+typedef void (job_function_t)(void *);
+
+/*
+ * A job is a run-to-completion handler. All jobs share the job runner task's stack, so a job
+ * must return rather than block (don't sleep or wait on queues inside a job).
+ * Priorities work like task priorities, 0 is the highest. Pending jobs run highest first, and a
+ * job activated from inside a lower priority job runs nested inside it. A job activated by a
+ * task or interrupt while the job runner is part way through a job waits for it to return,
+ * whatever its priority.
+ */
+struct job_s
+{
+    struct job_s *next_pending;
+    job_function_t *function;
+    void *arg;
+    unsigned priority;
+    bool pending;
+};
+
+typedef struct job_s job_t;
+
+/* Everything about a task that never changes, so it can be kept in flash */
+typedef struct
+{
+    task_t          *task;
+    task_function_t *function;
+    uint32_t        *stack;
+    unsigned         stack_words;
+    unsigned         priority;
+} task_desc_t;
+
+/* One entry in a select_queue() call: wait until amount bytes can be read (or written) */
+typedef struct
+{
+    queue_t *queue;
+    unsigned amount;
+    bool     write;
+} queue_select_t;
 
 #define DECLARE_QUEUE(queue_name, length_plus_one)  \
 static uint8_t queue_name##_data_[length_plus_one]; \
-queue_t queue_name = {0, 0, length_plus_one, queue_name##_data_, NULL}
+queue_t queue_name = {0, 0, length_plus_one, queue_name##_data_, NULL, NULL, NULL}
+
+/*
+ * Declare a whole set of tasks at compile time. The list is a macro naming each task as
+ *     TASK(task_name, task_function, stack_words, priority)
+ * and this creates each task_t, its stack, and a const table of descriptors to pass to
+ * add_task_table(), e.g.
+ *     #define MY_TASKS(TASK)                      \
+ *         TASK(task1, task1_main, 128, 0)         \
+ *         TASK(task2, task2_main, 128, 1)
+ *     DECLARE_TASK_TABLE(my_tasks, MY_TASKS);
+ */
+#define DECLARE_TASK_STORAGE_(task_name, task_function, stack_words, priority)     \
+task_t task_name;                                                                   \
+static uint32_t task_name##_stack_[stack_words] __ALIGNED(8);
+
+#define TASK_DESC_(task_name, task_function, stack_words, priority)                \
+{&task_name, task_function, task_name##_stack_, stack_words, priority},
+
+#define DECLARE_TASK_TABLE(table_name, task_list)   \
+task_list(DECLARE_TASK_STORAGE_)                    \
+const task_desc_t table_name[] = {task_list(TASK_DESC_)}
+
+/* A message buffer is a queue holding length-prefixed messages - use only the message functions */
+#define DECLARE_MESSAGE_BUFFER(buffer_name, size)   \
+DECLARE_QUEUE(buffer_name, size)
+
+#define DECLARE_JOB(job_name, job_function, job_arg, job_priority)   \
+job_t job_name = {NULL, job_function, job_arg, job_priority, false}
+
+#define DECLARE_EVENT_GROUP(group_name)             \
+event_group_t group_name = {0, NULL, NULL, 0}
+
+/* Options for wait_event_bits() */
+#define EVENT_WAIT_ALL      1u      /* Wait for all the bits, rather than any of them       */
+#define EVENT_CLEAR_ON_EXIT 2u      /* Clear the bits waited for once the wait is satisfied */
+
+/* A queue set holds no data, it is only something for select_queue() to block on */
+#define DECLARE_QUEUE_SET(set_name)                 \
+queue_t set_name = {0, 0, 0, NULL, NULL, NULL, NULL}
 
 extern volatile uint32_t ticks;
 
@@ -48,13 +175,42 @@ extern bool read_queue(queue_t *q, uint8_t *buf, unsigned amount, int ticks_to_w
 extern bool write_queue(queue_t *q, const uint8_t *buf, unsigned amount, int ticks_to_wait);
 extern bool read_queue_irq(queue_t *q, uint8_t *buf, unsigned amount);
 extern bool write_queue_irq(queue_t *q, const uint8_t *buf, unsigned amount);
+extern bool write_message(queue_t *q, const uint8_t *buf, unsigned length, int ticks_to_wait);
+extern bool write_message_irq(queue_t *q, const uint8_t *buf, unsigned length);
+extern unsigned read_message(queue_t *q, uint8_t *buf, unsigned max_length, int ticks_to_wait);
+extern unsigned read_message_irq(queue_t *q, uint8_t *buf, unsigned max_length);
+extern const uint8_t *peek_message(queue_t *q, unsigned *length, int ticks_to_wait);
+extern void release_message(queue_t *q);
+#ifdef USE_QUEUE_STATS
+extern void register_queue(queue_t *q, const char *name);
+extern queue_t *next_registered_queue(queue_t *q);
+extern void get_queue_stats(queue_t *q, queue_stats_t *stats, bool reset);
+#endif
+extern int select_queue(queue_t *set, const queue_select_t *selects, unsigned num_selects,
+                        int ticks_to_wait);
+
+extern uint32_t wait_event_bits(event_group_t *group, uint32_t bits, unsigned options,
+                                int ticks_to_wait);
+extern uint32_t set_event_bits(event_group_t *group, uint32_t bits);
+extern uint32_t set_event_bits_irq(event_group_t *group, uint32_t bits);
+extern uint32_t clear_event_bits(event_group_t *group, uint32_t bits);
+extern uint32_t clear_event_bits_irq(event_group_t *group, uint32_t bits);
 
+extern __NO_RETURN void job_runner(void *arg);
+extern void activate_job(job_t *job);
+extern void activate_job_irq(job_t *job);
+extern void attach_job(queue_t *q, job_t *job);
+extern void attach_event_job(event_group_t *group, uint32_t bits, job_t *job);
 
 extern void sleep(uint32_t ticks_to_sleep);
 extern void sleep_until(uint32_t target_ticks);
+extern void set_task_period(task_t *task, uint32_t period, uint32_t relative_deadline);
+extern void wait_for_next_period(void);
+extern bool get_next_wakeup(uint32_t *wakeup_ticks);
 
 extern int add_task(task_function_t *task_function, task_t *task, uint32_t *stack,
                     unsigned stack_words, unsigned priority);
+extern int add_task_table(const task_desc_t *table, unsigned num_tasks);
 extern __NO_RETURN void start_rtos(void);
 extern void yield(void);
 extern void wake_task_realtime(task_t *task);
@@ -62,4 +218,11 @@ extern void tick(void);
 
 extern void idle_low_power_hook(void) __attribute__((weak)) __attribute__((used));
 
+#ifdef USE_SUPERVISOR
+extern task_t * volatile supervisor_failed_task;
+extern void supervise_task(task_t *task, uint32_t timeout_ticks);
+extern void supervisor_check_in(void);
+extern void supervisor_kick_hook(void) __attribute__((weak)) __attribute__((used));
+#endif
+
 #endif
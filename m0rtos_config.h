@@ -26,3 +26,29 @@
 #define LOW_PRIO_IRQS       0x30000000 
 
 #define NUM_TASK_PRIOS      4
+
+/* The idle task's stack - make it bigger if idle_low_power_hook() needs more */
+#ifndef IDLE_TASK_STACK_WORDS
+#define IDLE_TASK_STACK_WORDS   48
+#endif
+
+/*
+ * Tasks at this priority are scheduled earliest-deadline-first instead of round-robin
+ * Leave undefined to use fixed priorities only
+ */
+/* #define EDF_TASK_PRIO       1 */
+
+/*
+ * Supervise task liveness from the tick: tasks registered with supervise_task() must call
+ * supervisor_check_in() in time, or supervisor_kick_hook() stops being called
+ */
+/* #define USE_SUPERVISOR */
+
+/* Keep per-queue throughput and waiting statistics, see register_queue() */
+/* #define USE_QUEUE_STATS */
+
+/*
+ * Run the scheduler, tick and queue code from RAM, so it doesn't wait for the flash
+ * The scatter file must place the m0rtos_ram section in RAM, see Keil/m0rtos.sct
+ */
+/* #define KERNEL_IN_RAM */
@@ -10,44 +10,125 @@
 #include "m0rtos.h"
 #include "float32.h"
 #include "util.h"
+#include "bench.h"
+#include "power.h"
 
 #define GET_LPUART_BRR_VALUE(UART_CLOCK, BAUDRATE)  (((UART_CLOCK * 16) + (BAUDRATE / 32)) / (BAUDRATE / 16))
 #define GET_USART_BRR_VALUE(UART_CLOCK, BAUDRATE)   (((UART_CLOCK) + (BAUDRATE / 2)) / (BAUDRATE))
 
 #define TICKS_PER_SECOND            100
+#define LSI_HZ                      37000
+#define HSI_HZ                      16000000
+#define SYS_CLOCK_HZ                32000000
 
-task_t task1, task2, task3, task4;
-uint32_t task1_stack[128] __ALIGNED(8);
-uint32_t task2_stack[128] __ALIGNED(8);
-uint32_t task3_stack[128] __ALIGNED(8);
-uint32_t task4_stack[128] __ALIGNED(8);
+/*
+ * Carry on running from HSI16 straight after waking from Stop, and switch back to the PLL from
+ * RCC_IRQHandler once it has locked. Set to 0 to wait for the PLL with interrupts disabled.
+ */
+#define FAST_STOP_WAKEUP            1
+
+/*
+ * Define to drive a GPIOB pin high from waking out of Stop until back at full speed, to see the
+ * wake-up timing on a scope (PB3 is the LED on a Nucleo-L031K6)
+ */
+/* #define WAKE_TIMING_PIN             LL_GPIO_PIN_3 */
+
+/* SysTick free-runs (with no interrupt) to time the wake-up, counting core clocks */
+#define SYSTICK_MAX                 0x00ffffffu
+
+/*
+ * The supervisor kicks the independent watchdog from the tick while every task checks in on
+ * time, and each task's time allowed between check-ins
+ */
+#define WATCHDOG_TIMEOUT_MS         1000
+#define TASK1_CHECK_IN_TICKS        1100    /* Runs every 1000 ticks                     */
+#define TASK2_CHECK_IN_TICKS        1000    /* Up to 3 * (5 + 275) ticks plus its spin   */
+#define TASK3_CHECK_IN_TICKS        100
+#define TASK4_CHECK_IN_TICKS        100
+
+void task1_main(void *arg);
+void task2_main(void *arg);
+void task3_main(void *arg);
+void task4_main(void *arg);
+
+/* The task set is fixed, so the descriptors live in flash */
+#define DEMO_TASKS(TASK)                \
+    TASK(task4, task4_main, 128, 2)     \
+    TASK(task3, task3_main, 128, 2)     \
+    TASK(task2, task2_main, 128, 1)     \
+    TASK(task1, task1_main, 128, 0)
+
+#ifndef BENCHMARK
+DECLARE_TASK_TABLE(demo_tasks, DEMO_TASKS);
+#endif
 
 DECLARE_QUEUE(queue1, 6);
 DECLARE_QUEUE(lpuart_outq, 101);
 
 volatile bool safe_to_stop = true;
 
+/*
+ * Stop mode wake-up timing. The only clocks that run in Stop are the slow ones, so the time from
+ * the wake-up event to the first instruction is an upper bound from the LPTIM count (27us steps),
+ * and only known when the tick woke us. The time from there to full speed is counted exactly.
+ */
+typedef struct
+{
+    uint32_t stop_wakes;
+    uint32_t first_instruction_max_us;
+    uint32_t full_speed_total_us;
+    uint32_t full_speed_max_us;
+    uint32_t full_speed_count;
+} wake_stats_t;
+
+static volatile wake_stats_t wake_stats;
+static uint32_t wake_systick;
+
+static bool watchdog_reset;
+
+#ifdef USE_QUEUE_STATS
+/*
+ * Dump the statistics of every registered queue, and start counting again
+ */
+static void print_queue_stats(void)
+{
+    queue_stats_t stats;
+    queue_t *q;
+
+    for (q = next_registered_queue(NULL); q; q = next_registered_queue(q))
+    {
+        get_queue_stats(q, &stats, true);
+        dprintf("%s: %u bytes in, %u out, peak %d/%u, blocked %u r %u w for %u ticks, "
+                "%u timeouts\n", stats.name, stats.bytes_written, stats.bytes_read,
+                stats.peak_level, q->max - 1, stats.reader_blocks, stats.writer_blocks,
+                stats.blocked_ticks, stats.timeouts);
+    }
+}
+#endif
+
 void task1_main(void *arg)
 {
     uint32_t tick_target;
     unsigned i;
     const uint8_t my_data[2] = {'a', 'b'};
 
-#ifdef BENCHMARK
-    uint32_t ticks1 = ticks;
-    while (ticks1 == ticks);
-    ticks1 = ticks;
-    for (volatile unsigned i = 0; i < 10000000; ++i);
-    uint32_t ticks2 = ticks;
-    dprintf("\nLoop took %u ticks\n", ticks2 - ticks1);
-#endif
-    
     dprintf("\nHello world!\n");
+    if (watchdog_reset)
+    {
+        dprintf("Reset by the watchdog\n");
+    }
     f32_test();
+    power_test();
 
+#ifdef USE_SUPERVISOR
+    supervise_task(&task1, TASK1_CHECK_IN_TICKS);
+#endif
     tick_target = ticks;
     while(1)
     {
+#ifdef USE_SUPERVISOR
+        supervisor_check_in();
+#endif
         tick_target += 1000;
         sleep_until(tick_target);
         for (i = 0; i < 4; ++i)
@@ -61,6 +142,17 @@ void task1_main(void *arg)
                 dprintf("-");
             }
         }
+        if (wake_stats.full_speed_count)
+        {
+            dprintf("\n%u Stop wakes at %u Hz, first instruction <= %u us, full speed after %u us "
+                    "(max %u us)\n", wake_stats.stop_wakes, get_core_clock_hz(),
+                    wake_stats.first_instruction_max_us,
+                    wake_stats.full_speed_total_us / wake_stats.full_speed_count,
+                    wake_stats.full_speed_max_us);
+        }
+#ifdef USE_QUEUE_STATS
+        print_queue_stats();
+#endif
     }
 }
 
@@ -70,8 +162,14 @@ void task2_main(void *arg)
     unsigned i;
     uint8_t my_data;
     
+#ifdef USE_SUPERVISOR
+    supervise_task(&task2, TASK2_CHECK_IN_TICKS);
+#endif
     while(1)
     {
+#ifdef USE_SUPERVISOR
+        supervisor_check_in();
+#endif
         for (volatile unsigned i = 0; i < 100000; ++i)
         {
             /* spin */
@@ -87,8 +185,14 @@ void task2_main(void *arg)
 
 void task3_main(void *arg)
 {
+#ifdef USE_SUPERVISOR
+    supervise_task(&task3, TASK3_CHECK_IN_TICKS);
+#endif
     while(1)
     {
+#ifdef USE_SUPERVISOR
+        supervisor_check_in();
+#endif
         for (volatile unsigned i = 0; i < 50000; ++i)
         {
             /* spin */
@@ -100,8 +204,14 @@ void task3_main(void *arg)
 
 void task4_main(void *arg)
 {
+#ifdef USE_SUPERVISOR
+    supervise_task(&task4, TASK4_CHECK_IN_TICKS);
+#endif
     while(1)
     {
+#ifdef USE_SUPERVISOR
+        supervisor_check_in();
+#endif
         for (volatile unsigned i = 0; i < 50000; ++i)
         {
             /* spin */
@@ -162,8 +272,7 @@ void LPUART1_IRQHandler(void)
 
 void init_lpuart1(void)
 {
-    /* Select APB1 clock for LPUART1 and GPIOA */
-    LL_RCC_SetLPUARTClockSource(LL_RCC_LPUART1_CLKSOURCE_PCLK1);
+    /* Enable the clocks to LPUART1 and GPIOA */
     RCC->APB1ENR |= RCC_APB1ENR_LPUART1EN;
     RCC->IOPENR |= RCC_IOPENR_IOPAEN;
 
@@ -173,9 +282,12 @@ void init_lpuart1(void)
     LL_GPIO_SetAFPin_0_7(GPIOA, LL_GPIO_PIN_2, LL_GPIO_AF_6);
     LL_GPIO_SetAFPin_0_7(GPIOA, LL_GPIO_PIN_3, LL_GPIO_AF_6);
     
+    /* Clock LPUART1 from HSI16, so the baud rate doesn't change while we wait for the PLL */
+    LL_RCC_SetLPUARTClockSource(LL_RCC_LPUART1_CLKSOURCE_HSI);
+
     /* Initialise LPUART1 */
     LPUART1->CR1 = USART_CR1_TE | USART_CR1_RE;
-    LPUART1->BRR = GET_LPUART_BRR_VALUE(32000000, 115200);
+    LPUART1->BRR = GET_LPUART_BRR_VALUE(HSI_HZ, 115200);
     LL_LPUART_Enable(LPUART1);
     
     NVIC_EnableIRQ(LPUART1_IRQn);
@@ -211,6 +323,38 @@ void init_lptim(unsigned clocks_per_tick)
     LPTIM1->CR |= LPTIM_CR_CNTSTRT;
 }
 
+#ifdef USE_SUPERVISOR
+/*
+ * Start the independent watchdog. It runs from LSI, and keeps running in Stop mode (as does the
+ * tick that kicks it). Once started it can't be stopped.
+ */
+static void init_watchdog(void)
+{
+#ifndef NDEBUG
+    /* Stop the watchdog when the debugger stops */
+    RCC->APB2ENR |= RCC_APB2ENR_DBGEN;
+    DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;
+#endif
+    IWDG->KR  = 0xcccc;                     /* Start                                */
+    IWDG->KR  = 0x5555;                     /* Unlock PR and RLR                    */
+    IWDG->PR  = 3;                          /* LSI / 32                             */
+    IWDG->RLR = LSI_HZ / 32 * WATCHDOG_TIMEOUT_MS / 1000;
+    while (IWDG->SR)
+    {
+        /* Wait for the new values to reach the LSI clock domain */
+    }
+    IWDG->KR  = 0xaaaa;
+}
+
+/*
+ * Called from tick() as long as every supervised task has checked in on time
+ */
+void supervisor_kick_hook(void)
+{
+    IWDG->KR = 0xaaaa;
+}
+#endif
+
 void init_low_power(void)
 {
     /* Enable the clock to the power controller */
@@ -226,52 +370,193 @@ void init_low_power(void)
     LL_RCC_SetClkAfterWakeFromStop(LL_RCC_STOP_WAKEUPCLOCK_HSI);
 }
 
-void idle_low_power_hook(void)
+/*
+ * LPTIM1 counts LSI clocks, and keeps running in Stop mode
+ * It's clocked asynchronously, so only trust the count if two reads in a row agree.
+ */
+static uint32_t read_lptim_count(void)
 {
-    /* First a quick check without masking interrupts, so we don't upset the realtime stuff */
-    if (safe_to_stop)
+    uint32_t count;
+
+    do
     {
-        __disable_irq();
-        /* Now re-check with interrupts masked, before we finally decide to enter Stop mode */
-        if (safe_to_stop)
-        {
-            /* Disable the ADC */
-            //ADC1->CR |= ADC_CR_ADDIS;
-            /* Set the M0 to go into Deep Sleep */
-            SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
-            /* Disable everything we can, and wake up fast */
-            PWR->CR |= PWR_CR_ULP | PWR_CR_FWU;
-            __DSB();
-            __WFI();
-            PWR->CR &= ~(PWR_CR_ULP | PWR_CR_FWU);
-            SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
-            /* Enable the ADC */
-            //ADC1->CR |= ADC_CR_ADEN;
-            
-#if SYS_CLOCK_HZ == 32000000            
-            /* Re-configure and enable the PLL at 32MHz (HSI x 4 / 2) */
-            LL_RCC_PLL_ConfigDomain_SYS(LL_RCC_PLLSOURCE_HSI, RCC_CFGR_PLLMUL4, RCC_CFGR_PLLDIV2);
-            LL_RCC_PLL_Enable();
-            while (!LL_RCC_PLL_IsReady())
-            {
-                /* Wait for PLL to be ready */
-            }
-            /* Switch SysClk over to the 32MHz PLL output */
-            LL_RCC_SetSysClkSource(LL_RCC_SYS_CLKSOURCE_PLL);
-            while (LL_RCC_GetSysClkSource() != LL_RCC_SYS_CLKSOURCE_STATUS_PLL)
-            {
-                /* Wait for system clock to switch to PLL */
-            }
+        count = LPTIM1->CNT;
+    } while (count != LPTIM1->CNT);
+    return count;
+}
+
+static uint32_t board_time_us(void)
+{
+    uint32_t count, tick_count;
+
+    tick_count = ticks;
+    count = read_lptim_count();
+    if (LPTIM1->ISR & LPTIM_ISR_ARRM)
+    {
+        /* The tick interrupt is pending, so the count has already wrapped */
+        ++tick_count;
+        count = read_lptim_count();
+    }
+    return tick_count * (1000000 / TICKS_PER_SECOND) + count * 1000000 / LSI_HZ;
+}
+
+static uint32_t board_time_to_tick_us(void)
+{
+    uint32_t count;
+
+    if (LPTIM1->ISR & LPTIM_ISR_ARRM)
+    {
+        return 0;
+    }
+    count = read_lptim_count();
+    return (LPTIM1->ARR - count) * 1000000 / LSI_HZ;
+}
+
+static void set_core_clock(uint32_t hz)
+{
+    SystemCoreClock = hz;
+    power_set_core_clock_hz(hz);
+}
+
+/*
+ * Called straight after waking from Stop, before anything else
+ */
+static void note_stop_wakeup(void)
+{
+    uint32_t us;
+
+    wake_systick = SysTick->VAL;
+#ifdef WAKE_TIMING_PIN
+    LL_GPIO_SetOutputPin(GPIOB, WAKE_TIMING_PIN);
 #endif
+    ++wake_stats.stop_wakes;
+    if (LPTIM1->ISR & LPTIM_ISR_ARRM)
+    {
+        /* The tick woke us, and LPTIM has counted on from zero since */
+        us = (read_lptim_count() + 1) * 1000000 / LSI_HZ;
+        if (us > wake_stats.first_instruction_max_us)
+        {
+            wake_stats.first_instruction_max_us = us;
         }
-        __enable_irq();
     }
-    else
+}
+
+/*
+ * Called just before switching back to the PLL, while still running from HSI16
+ */
+static void note_full_speed(void)
+{
+    uint32_t us;
+
+    us = ((wake_systick - SysTick->VAL) & SYSTICK_MAX) / (HSI_HZ / 1000000);
+    wake_stats.full_speed_total_us += us;
+    ++wake_stats.full_speed_count;
+    if (us > wake_stats.full_speed_max_us)
+    {
+        wake_stats.full_speed_max_us = us;
+    }
+#ifdef WAKE_TIMING_PIN
+    LL_GPIO_ResetOutputPin(GPIOB, WAKE_TIMING_PIN);
+#endif
+}
+
+static void switch_to_pll(void)
+{
+    note_full_speed();
+    /* Switch SysClk over to the 32MHz PLL output */
+    LL_RCC_SetSysClkSource(LL_RCC_SYS_CLKSOURCE_PLL);
+    while (LL_RCC_GetSysClkSource() != LL_RCC_SYS_CLKSOURCE_STATUS_PLL)
+    {
+        /* Wait for system clock to switch to PLL */
+    }
+    set_core_clock(SYS_CLOCK_HZ);
+}
+
+/*
+ * The PLL has locked after a Stop wake-up (FAST_STOP_WAKEUP)
+ */
+void RCC_IRQHandler(void)
+{
+    if (RCC->CIFR & RCC_CIFR_PLLRDYF)
+    {
+        RCC->CICR = RCC_CICR_PLLRDYC;
+        RCC->CIER &= ~RCC_CIER_PLLRDYIE;
+        switch_to_pll();
+    }
+}
+
+/*
+ * Enter a low power state, with interrupts disabled, and return once woken
+ */
+static void board_enter_power_state(power_state_t state)
+{
+    switch (state)
     {
+    case POWER_SLEEP:
+    default:
+        __WFI();
+        break;
+
+    case POWER_LP_SLEEP:
+        /* Power the flash down while we sleep */
+        FLASH->ACR |= FLASH_ACR_SLEEP_PD;
         __WFI();
+        FLASH->ACR &= ~FLASH_ACR_SLEEP_PD;
+        break;
+
+    case POWER_STOP:
+        /* Disable the ADC */
+        //ADC1->CR |= ADC_CR_ADDIS;
+        /* Set the M0 to go into Deep Sleep */
+        SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+        /* Disable everything we can, and wake up fast */
+        PWR->CR |= PWR_CR_ULP | PWR_CR_FWU;
+        __DSB();
+        __WFI();
+        note_stop_wakeup();
+        PWR->CR &= ~(PWR_CR_ULP | PWR_CR_FWU);
+        SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+        /* Enable the ADC */
+        //ADC1->CR |= ADC_CR_ADEN;
+        
+        /* We're running from HSI16 now */
+        set_core_clock(HSI_HZ);
+#if SYS_CLOCK_HZ == 32000000            
+        /* Re-configure and enable the PLL at 32MHz (HSI x 4 / 2) */
+        LL_RCC_PLL_ConfigDomain_SYS(LL_RCC_PLLSOURCE_HSI, RCC_CFGR_PLLMUL4, RCC_CFGR_PLLDIV2);
+#if FAST_STOP_WAKEUP
+        /* Don't wait: RCC_IRQHandler switches over once the PLL has locked */
+        RCC->CICR = RCC_CICR_PLLRDYC;
+        RCC->CIER |= RCC_CIER_PLLRDYIE;
+        LL_RCC_PLL_Enable();
+#else
+        LL_RCC_PLL_Enable();
+        while (!LL_RCC_PLL_IsReady())
+        {
+            /* Wait for PLL to be ready */
+        }
+        switch_to_pll();
+#endif
+#else
+        note_full_speed();
+#endif
+        break;
     }
 }
 
+static const power_platform_t board_power =
+{
+    board_time_us,
+    board_time_to_tick_us,
+    board_enter_power_state
+};
+
+void idle_low_power_hook(void)
+{
+    /* Stop mode is only allowed while nothing needs the high speed clocks */
+    power_idle(safe_to_stop);
+}
+
 int outbyte(int c)
 {
     uint8_t data = (uint8_t)c;
@@ -292,16 +577,43 @@ void __NO_RETURN main(void)
     /* Enable prefetch (but not pre-read unless you're doing lots of queueing) */
     FLASH->ACR |= FLASH_ACR_PRFTEN;
 
+    /* Note (and clear) a reset by the watchdog, so task1 can report it */
+    watchdog_reset = (RCC->CSR & RCC_CSR_IWDGRSTF) != 0;
+    RCC->CSR |= RCC_CSR_RMVF;
+
     init_low_power();
+    power_init(&board_power);
+    set_core_clock(SYS_CLOCK_HZ);
+
+    /* Free-running SysTick for wake-up timing, with no interrupt */
+    SysTick->LOAD = SYSTICK_MAX;
+    SysTick->VAL  = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+#ifdef WAKE_TIMING_PIN
+    RCC->IOPENR |= RCC_IOPENR_IOPBEN;
+    LL_GPIO_SetPinMode(GPIOB, WAKE_TIMING_PIN, LL_GPIO_MODE_OUTPUT);
+#endif
     init_lpuart1();
     //init_usart2();
 
-    add_task(task4_main, &task4, task4_stack, sizeof(task4_stack) / 4, 2);
-    add_task(task3_main, &task3, task3_stack, sizeof(task3_stack) / 4, 2);
-    add_task(task2_main, &task2, task2_stack, sizeof(task2_stack) / 4, 1);
-    add_task(task1_main, &task1, task1_stack, sizeof(task1_stack) / 4, 0);
+#ifdef BENCHMARK
+    /* Run the kernel benchmarks (bench.c) instead of the demo */
+    bench_add_tasks();
+#else
+    add_task_table(demo_tasks, sizeof(demo_tasks) / sizeof(demo_tasks[0]));
+#ifdef USE_QUEUE_STATS
+    register_queue(&queue1, "queue1");
+    register_queue(&lpuart_outq, "lpuart_outq");
+#endif
+#ifdef USE_SUPERVISOR
+    init_watchdog();
+#endif
+#endif
     
-    init_lptim(37000 / TICKS_PER_SECOND);
+    init_lptim(LSI_HZ / TICKS_PER_SECOND);
+#if FAST_STOP_WAKEUP
+    NVIC_EnableIRQ(RCC_IRQn);
+#endif
     start_rtos();
     
     while(1)
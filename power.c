@@ -0,0 +1,197 @@
+/*
+ * power.c
+ *
+ *  Choose a low power state for the idle task, based on how long it's likely to be idle
+ *
+ * The CPU wakes at every tick, so the time it can stay asleep is the time to the next tick.
+ * Deeper states are only used if that is longer than their break-even time. If a task is due
+ * to wake at the next tick, it will also see the exit latency, so then only states that wake
+ * quickly are allowed. Everything specific to the chip is done by the board's power_platform_t.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "m0rtos.h"
+#include "power.h"
+
+#define INCLUDE_POWER_TESTS     1
+
+typedef struct
+{
+    uint32_t exit_latency_us;
+    uint32_t break_even_us;
+} power_cost_t;
+
+static const power_cost_t power_costs[NUM_POWER_STATES] =
+{
+    {0,                      0},
+    {POWER_LP_SLEEP_EXIT_US, POWER_LP_SLEEP_BREAK_EVEN_US},
+    {POWER_STOP_EXIT_US,     POWER_STOP_BREAK_EVEN_US},
+};
+
+static const power_platform_t *power_platform;
+static volatile uint32_t core_clock_hz;
+
+power_stats_t power_stats;
+
+void power_init(const power_platform_t *platform)
+{
+    power_platform = platform;
+}
+
+/*
+ * The board calls this whenever it changes the core clock, e.g. running from HSI16 after Stop
+ * until the PLL has locked again
+ */
+void power_set_core_clock_hz(uint32_t hz)
+{
+    core_clock_hz = hz;
+}
+
+/*
+ * The current core clock frequency, for tasks that need to know how fast they're running
+ */
+uint32_t get_core_clock_hz(void)
+{
+    return core_clock_hz;
+}
+
+/*
+ * Pick the deepest state that pays for itself before the next tick, and doesn't delay a task
+ * that's due to wake at that tick by too much
+ */
+power_state_t choose_power_state(uint32_t us_to_tick, uint32_t ticks_to_wakeup, bool stop_allowed)
+{
+    power_state_t state = POWER_SLEEP;
+    unsigned deeper;
+
+    for (deeper = POWER_LP_SLEEP; deeper < NUM_POWER_STATES; ++deeper)
+    {
+        if (deeper == POWER_STOP && !stop_allowed)
+        {
+            break;
+        }
+        if (us_to_tick < power_costs[deeper].break_even_us)
+        {
+            break;
+        }
+        if (ticks_to_wakeup <= 1 && power_costs[deeper].exit_latency_us > POWER_MAX_TASK_LATENCY_US)
+        {
+            break;
+        }
+        state = (power_state_t)deeper;
+    }
+    return state;
+}
+
+/*
+ * Enter a state and add the time spent in it to the residency stats
+ * Must be called with interrupts disabled
+ */
+static void idle_in_state(const power_platform_t *platform, power_stats_t *stats,
+                          power_state_t state)
+{
+    uint32_t start;
+
+    start = platform->time_us();
+    platform->enter(state);
+    stats->residency_us[state] += platform->time_us() - start;
+    ++stats->entries[state];
+}
+
+/*
+ * Call from idle_low_power_hook() with interrupts enabled. Set stop_allowed to false if
+ * something (e.g. a peripheral that needs its clock) rules out Stop mode right now.
+ */
+void power_idle(bool stop_allowed)
+{
+    uint32_t wakeup_ticks, ticks_to_wakeup = POWER_NO_WAKEUP;
+    power_state_t state;
+
+    __disable_irq();
+    if (get_next_wakeup(&wakeup_ticks))
+    {
+        ticks_to_wakeup = (int32_t)(wakeup_ticks - ticks) > 0 ? wakeup_ticks - ticks : 0;
+    }
+    state = choose_power_state(power_platform->time_to_tick_us(), ticks_to_wakeup, stop_allowed);
+    idle_in_state(power_platform, &power_stats, state);
+    __enable_irq();
+}
+
+#if INCLUDE_POWER_TESTS
+#include "util.h"
+
+/* A simulated board: entering any state just moves the clock on to the next tick */
+static uint32_t sim_time_us, sim_us_to_tick;
+
+static uint32_t sim_time(void)
+{
+    return sim_time_us;
+}
+
+static uint32_t sim_time_to_tick(void)
+{
+    return sim_us_to_tick;
+}
+
+static void sim_enter(power_state_t state)
+{
+    sim_time_us += sim_us_to_tick;
+}
+
+static const power_platform_t sim_platform = {sim_time, sim_time_to_tick, sim_enter};
+
+static const struct
+{
+    uint32_t      us_to_tick;
+    uint32_t      ticks_to_wakeup;
+    bool          stop_allowed;
+    power_state_t expected;
+} power_test_cases[] =
+{
+    {10000, POWER_NO_WAKEUP, true,  POWER_STOP},        /* Nothing to do for ages            */
+    {10000, 5,               true,  POWER_STOP},        /* Tick interrupt only, latency ok   */
+    {10000, 5,               false, POWER_LP_SLEEP},    /* Stop vetoed                       */
+    {10000, 1,               true,  POWER_LP_SLEEP},    /* Task due next tick, too slow      */
+    {10000, 0,               true,  POWER_LP_SLEEP},    /* Task overdue                      */
+    {1500,  5,               true,  POWER_LP_SLEEP},    /* Not long enough to pay for Stop   */
+    {2000,  5,               true,  POWER_STOP},        /* Just long enough                  */
+    {99,    POWER_NO_WAKEUP, true,  POWER_SLEEP},       /* Tick too close for anything else  */
+    {0,     1,               true,  POWER_SLEEP},
+};
+
+/*
+ * The idle task keeps using the real platform and power_stats while this runs (e.g. when
+ * dprintf() blocks), so the test has its own stats and never touches the globals
+ */
+void power_test(void)
+{
+    power_stats_t sim_stats = {{0}};
+    uint64_t expected_us[NUM_POWER_STATES] = {0};
+    power_state_t state;
+    bool pass;
+    unsigned i;
+
+    for (i = 0; i < sizeof(power_test_cases) / sizeof(power_test_cases[0]); ++i)
+    {
+        sim_us_to_tick = power_test_cases[i].us_to_tick;
+        state = choose_power_state(sim_us_to_tick, power_test_cases[i].ticks_to_wakeup,
+                                   power_test_cases[i].stop_allowed);
+        idle_in_state(&sim_platform, &sim_stats, state);
+        expected_us[power_test_cases[i].expected] += sim_us_to_tick;
+
+        pass = state == power_test_cases[i].expected;
+        dprintf("%s power state %u for %u us to tick, wake in %d ticks, stop %s\n",
+                pass ? " PASS" : "*FAIL", state, sim_us_to_tick,
+                (int)power_test_cases[i].ticks_to_wakeup,
+                power_test_cases[i].stop_allowed ? "allowed" : "vetoed");
+    }
+
+    for (state = POWER_SLEEP; state < NUM_POWER_STATES; ++state)
+    {
+        pass = sim_stats.residency_us[state] == expected_us[state];
+        dprintf("%s power state %u residency %u us\n", pass ? " PASS" : "*FAIL", state,
+                (uint32_t)sim_stats.residency_us[state]);
+    }
+}
+#endif /* INCLUDE_POWER_TESTS */
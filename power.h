@@ -0,0 +1,72 @@
+/*
+ * power.h
+ *
+ *  Choose a low power state for the idle task, based on how long it's likely to be idle
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Deeper states save more power, but take longer to get into and out of */
+typedef enum
+{
+    POWER_SLEEP,        /* WFI, everything else left running                      */
+    POWER_LP_SLEEP,     /* WFI with the flash powered down                         */
+    POWER_STOP,         /* Deep sleep, PLL off - only the tick timer keeps running */
+    NUM_POWER_STATES
+} power_state_t;
+
+/*
+ * Costs of each state on the target. The break-even time is the shortest stay for which it
+ * saves energy overall; the exit latency is from the wake-up interrupt until the CPU is back
+ * at full speed. These are estimates for an STM32L031 at 32MHz - define your own to override.
+ */
+#ifndef POWER_LP_SLEEP_EXIT_US
+#define POWER_LP_SLEEP_EXIT_US          10
+#endif
+#ifndef POWER_LP_SLEEP_BREAK_EVEN_US
+#define POWER_LP_SLEEP_BREAK_EVEN_US    100
+#endif
+#ifndef POWER_STOP_EXIT_US
+#define POWER_STOP_EXIT_US              250
+#endif
+#ifndef POWER_STOP_BREAK_EVEN_US
+#define POWER_STOP_BREAK_EVEN_US        2000
+#endif
+
+/* The most wake-up latency a task due at the next tick should see */
+#ifndef POWER_MAX_TASK_LATENCY_US
+#define POWER_MAX_TASK_LATENCY_US       50
+#endif
+
+/* ticks_to_wakeup when no task is waiting for a time */
+#define POWER_NO_WAKEUP                 0xffffffffu
+
+/* What power.c needs from the board */
+typedef struct
+{
+    uint32_t (*time_us)(void);              /* A clock that keeps running in every state    */
+    uint32_t (*time_to_tick_us)(void);      /* Time until the next tick interrupt           */
+    void     (*enter)(power_state_t state); /* Enter a state, return once woken             */
+} power_platform_t;
+
+typedef struct
+{
+    uint32_t entries[NUM_POWER_STATES];
+    uint64_t residency_us[NUM_POWER_STATES];
+} power_stats_t;
+
+extern power_stats_t power_stats;
+
+extern void power_init(const power_platform_t *platform);
+extern power_state_t choose_power_state(uint32_t us_to_tick, uint32_t ticks_to_wakeup,
+                                        bool stop_allowed);
+extern void power_idle(bool stop_allowed);
+extern void power_set_core_clock_hz(uint32_t hz);
+extern uint32_t get_core_clock_hz(void);
+extern void power_test(void);
+
+#endif /* POWER_H_ */
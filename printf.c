@@ -151,8 +151,13 @@ static int printi(char **out, int i, int b, int sg, int width, int pad, int letb
 
 static int printfloat( char **out, void *f, int width, bool plus, int pad)
 {
-    char buf[20];
+    /* Sign, 10 integer digits, point, up to 20 decimal places, then b and a signed exponent */
+    char buf[40];
     
+    if (width > 20)
+    {
+        width = 20;
+    }
     sprint_f32(buf, f, width, plus, pad & PAD_ZERO);
     return prints(out, buf, 0, 0);
 }
@@ -206,7 +211,7 @@ static int print(char **out, const char *format, va_list args )
             }
             if( *format == 's' ) 
             {
-                s = (char *)va_arg( args, int );
+                s = va_arg( args, char * );
                 pc += prints (out, s ? s : "(null)", width, pad);
                 continue;
             }